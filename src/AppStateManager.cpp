@@ -21,10 +21,13 @@
 #include <OgreConfigFile.h>
 #include <OgreRoot.h>
 #include <OgreRenderWindow.h>
+#include <OgreDefaultHardwareBufferManager.h>
+#include <OgreLogManager.h>
 
 #include <OIS/OISInputManager.h>
 
 #include <boost/filesystem.hpp>
+#include <boost/date_time.hpp>
 
 /*#include <RendererModules/Ogre/CEGUIOgreRenderer.h>
 #include <CEGUIImageset.h>
@@ -53,16 +56,18 @@
 
 AppStateManager * AppStateManager::Singleton;
 
-AppStateManager::AppStateManager(std::string SettingsDir) :
+AppStateManager::AppStateManager(std::string SettingsDir, bool Headless) :
 	_OgreRoot(0),
 	_Window(0),
 	_Timer(0),
+	_BufferManager(0),
 	_InputManager(0),
 	_Mouse(0),
 	_Keyboard(0),
 	//_CeguiRenderer(0),
 	//_CeguiRootWindow(0),
 	_Shutdown(false),
+	_Headless(Headless),
 	_SettingsDir(SettingsDir)
 {
 	if (Singleton) abort();
@@ -83,6 +88,15 @@ AppStateManager::AppStateManager(std::string SettingsDir) :
 	_LogDir = "/tmp";
 #endif
 
+	if (Headless)
+	{
+		// The buffer manager of a render system is replaced by one in
+		// system memory, which is enough to load the meshes
+		_OgreRoot = new Ogre::Root("", "", _LogDir + "/ogre-headless.log");
+		_BufferManager = new Ogre::DefaultHardwareBufferManager;
+		return;
+	}
+
 	_OgreRoot = new Ogre::Root("", SettingsDir + "ogre.cfg", _LogDir + "/ogre.log");
 
 #ifdef _WINDOWS
@@ -111,6 +125,10 @@ AppStateManager::~AppStateManager()
 		delete _OgreRoot;
 		_OgreRoot = 0;
 	}
+
+	// The meshes are destroyed with the root
+	delete _BufferManager;
+	_BufferManager = 0;
 }
 
 void AppStateManager::AddResourceDirectory(const std::string& path)
@@ -171,14 +189,22 @@ void AppStateManager::cleanupOIS(void)
 	}
 }
 
+void AppStateManager::setEventCallback(AppState * State)
+{
+	// No input devices in headless mode
+	if (_Keyboard)
+		_Keyboard->setEventCallback(State);
+	if (_Mouse)
+		_Mouse->setEventCallback(State);
+}
+
 void AppStateManager::Enter(std::shared_ptr<AppState> NewState)
 {
 	assert(!Singleton->StateStack.empty());
 
 	Singleton->StateStack.back()->Pause();
 	Singleton->StateStack.push_back(NewState);
-	Singleton->_Keyboard->setEventCallback(NewState.get());
-	Singleton->_Mouse->setEventCallback(NewState.get());
+	Singleton->setEventCallback(NewState.get());
 	NewState->Enter();
 }
 
@@ -194,14 +220,12 @@ void AppStateManager::Exit(void)
 	{
 		std::shared_ptr<AppState> NewState = Singleton->StateStack.back();
 
-		Singleton->_Keyboard->setEventCallback(NewState.get());
-		Singleton->_Mouse->setEventCallback(NewState.get());
+		Singleton->setEventCallback(NewState.get());
 		NewState->Resume();
 	}
 	else
 	{
-		Singleton->_Keyboard->setEventCallback(NULL);
-		Singleton->_Mouse->setEventCallback(NULL);
+		Singleton->setEventCallback(NULL);
 	}
 }
 
@@ -214,8 +238,7 @@ void AppStateManager::SwitchTo(std::shared_ptr<AppState> NewState)
 	Singleton->StateStack.pop_back();
 
 	Singleton->StateStack.push_back(NewState);
-	Singleton->_Keyboard->setEventCallback(NewState.get());
-	Singleton->_Mouse->setEventCallback(NewState.get());
+	Singleton->setEventCallback(NewState.get());
 	NewState->Enter();
 }
 
@@ -315,8 +338,7 @@ void AppStateManager::MainLoop(std::shared_ptr<AppState> InitialState)
 		Singleton->_OgreRoot->addFrameListener(Singleton);
 
 		Singleton->StateStack.push_back(InitialState);
-		Singleton->_Keyboard->setEventCallback(InitialState.get());
-		Singleton->_Mouse->setEventCallback(InitialState.get());
+		Singleton->setEventCallback(InitialState.get());
 		InitialState->Enter();
 
 		Singleton->_OgreRoot->startRendering();
@@ -332,6 +354,47 @@ void AppStateManager::MainLoop(std::shared_ptr<AppState> InitialState)
 	Singleton->cleanup();
 }
 
+void AppStateManager::HeadlessLoop(std::shared_ptr<AppState> InitialState, float TimeStep, int Frames)
+{
+	assert(Singleton->_Headless);
+
+	AddResourceDirectory(Singleton->_ResourcesDir + "/models");
+
+	boost::posix_time::ptime t1 = boost::posix_time::microsec_clock::universal_time();
+
+	Singleton->StateStack.push_back(InitialState);
+	InitialState->Enter();
+
+	boost::posix_time::ptime t2 = boost::posix_time::microsec_clock::universal_time();
+
+	int Frame = 0;
+	while(Frame < Frames && !Singleton->StateStack.empty())
+	{
+		Singleton->StateStack.back()->Update(TimeStep);
+		Frame++;
+	}
+
+	boost::posix_time::ptime t3 = boost::posix_time::microsec_clock::universal_time();
+
+	while(!Singleton->StateStack.empty())
+		Exit();
+
+	std::stringstream str;
+
+	str << "Headless: enter: .  .  .  .  .  .  .  .  .  .  " << t2 - t1;
+	Ogre::LogManager::getSingleton().logMessage(str.str());
+	str.str("");
+
+	const double Simulated = Frame * TimeStep;
+	const double Elapsed = (t3 - t2).total_microseconds() / 1.e6;
+	str << "Headless: update:.  .  .  .  .  .  .  .  .  .  " << t3 - t2 << " for " << Frame << " frames (" << Simulated << " s simulated";
+	if (Elapsed > 0)
+		str << ", " << Simulated / Elapsed << "x real time";
+	str << ")";
+	Ogre::LogManager::getSingleton().logMessage(str.str());
+	str.str("");
+}
+
 //Adjust mouse clipping area
 void AppStateManager::windowResized(Ogre::RenderWindow* rw)
 {
@@ -38,6 +38,7 @@ namespace Ogre
 	class Root;
 	class RenderWindow;
 	class Timer;
+	class HardwareBufferManager;
 }
 
 namespace OIS
@@ -56,12 +57,14 @@ private:
 	void setupOIS(void);
 	void cleanupOIS(void);
 	void cleanup(void);
+	void setEventCallback(AppState * State);
 
 	std::deque<std::shared_ptr<AppState> > StateStack;
 
 	Ogre::Root *           _OgreRoot;
 	Ogre::RenderWindow *   _Window;
 	Ogre::Timer *          _Timer;
+	Ogre::HardwareBufferManager * _BufferManager;
 
 	//OIS Input devices
 	OIS::InputManager *    _InputManager;
@@ -73,13 +76,16 @@ private:
 	//CEGUI::Window *        _CeguiRootWindow;
 
 	bool                   _Shutdown;
+	bool                   _Headless;
 	static AppStateManager * Singleton;
 	std::string            _SettingsDir;
 	std::string            _ResourcesDir;
 	std::string            _LogDir;
 
 public:
-	AppStateManager(std::string SettingsDir);
+	// Headless: no render system, no window and no input. Meshes are
+	// loaded in system memory, the states get no scene manager.
+	AppStateManager(std::string SettingsDir, bool Headless = false);
 	~AppStateManager();
 
 	static void AddResourceDirectory(std::string const& path);
@@ -90,11 +96,16 @@ public:
 	static void Exit(void);
 	static void MainLoop(std::shared_ptr<AppState> InitialState);
 
+	// Updates the state for a number of frames with a fixed time step, as
+	// fast as possible, and logs the time taken
+	static void HeadlessLoop(std::shared_ptr<AppState> InitialState, float TimeStep, int Frames);
+
 	static Ogre::Root *          GetOgreRoot(void)        { return Singleton->_OgreRoot; }
 	static Ogre::RenderWindow *  GetWindow(void)          { return Singleton->_Window; }
 	static OIS::InputManager *   GetInputManager(void)    { return Singleton->_InputManager; }
 	static OIS::Mouse *          GetMouse(void)           { return Singleton->_Mouse; }
 	static OIS::Keyboard *       GetKeyboard(void)        { return Singleton->_Keyboard; }
+	static bool                  IsHeadless(void)         { return Singleton->_Headless; }
 
 	//static CEGUI::Window *       GetCeguiRootWindow(void) { return Singleton->_CeguiRootWindow; }
 	//static CEGUI::OgreRenderer * GetOgreRenderer(void)    { return Singleton->_CeguiRenderer; }
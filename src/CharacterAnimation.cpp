@@ -23,113 +23,206 @@
 
 #include <boost/foreach.hpp>
 
-CharacterAnimation::CharacterAnimation(Ogre::Entity* ent)
+CharacterAnimation::CharacterAnimation(Ogre::Entity* ent, Ogre::MeshPtr const & mesh) :
+	_CurrentBlendState(-1)
 {
-	Ogre::AnimationStateSet * anims = ent->getAllAnimationStates();
+	Ogre::AnimationStateSet * anims;
+	if (ent)
+	{
+		anims = ent->getAllAnimationStates();
+		ent->getSkeleton()->setBlendMode(Ogre::ANIMBLEND_CUMULATIVE);
+	}
+	else if (mesh->hasSkeleton())
+	{
+		// Same as Entity
+		_Skeleton.reset(new Ogre::SkeletonInstance(mesh->getSkeleton()));
+		_Skeleton->load();
+		_Skeleton->setBlendMode(Ogre::ANIMBLEND_CUMULATIVE);
+
+		_States.reset(new Ogre::AnimationStateSet);
+		mesh->_initAnimationState(_States.get());
+		anims = _States.get();
+	}
+	else
+	{
+		return;
+	}
+
 	Ogre::AnimationStateIterator it = anims->getAnimationStateIterator();
 	while(it.hasMoreElements())
 	{
 		Ogre::AnimationState * as = it.getNext();
 		as->setWeight(0);
-		Animations.insert(std::make_pair(as->getAnimationName(), AnimState(as, 0, 5, 5, 1)));
+		Animations.push_back(AnimState(as, 0, 5, 5, 1));
+	}
+
+	// Ogre builds the key frame lists of an animation the first time it is
+	// applied, in the skeleton shared by all the instances: they are built
+	// here, so that the characters can then be animated on several threads
+	if (_Skeleton)
+	{
+		BOOST_FOREACH(auto & i, Animations)
+			i._as->setEnabled(true);
+
+		_Skeleton->setAnimationState(*_States);
+
+		BOOST_FOREACH(auto & i, Animations)
+			i._as->setEnabled(false);
 	}
-	
-	ent->getSkeleton()->setBlendMode(Ogre::ANIMBLEND_CUMULATIVE);
 }
 
-void CharacterAnimation::SetAnimation(std::string AnimName, float weight)
+CharacterAnimation::~CharacterAnimation()
 {
+}
+
+CharacterAnimation::Handle CharacterAnimation::Find(std::string const & AnimName) const
+{
+	for(size_t i = 0; i < Animations.size(); ++i)
+	{
+		if (Animations[i]._as->getAnimationName() == AnimName)
+			return i;
+	}
+
+	return InvalidHandle;
+}
+
+CharacterAnimation::BlendState CharacterAnimation::AddBlendState()
+{
+	_BlendStates.push_back(Blend());
+	return _BlendStates.size() - 1;
+}
+
+void CharacterAnimation::AddToBlendState(BlendState State, Handle Anim, float weight)
+{
+	if (Anim == InvalidHandle) return;
+
+	_BlendStates[State]._Handles.push_back(Anim);
+	_BlendStates[State]._Weights.push_back(weight);
+}
+
+void CharacterAnimation::SetBlendState(BlendState State)
+{
+	if (State == _CurrentBlendState) return;
+	_CurrentBlendState = State;
+
 	BOOST_FOREACH(auto & i, Animations)
 	{
-		if (i.first == AnimName)
-		{
-			i.second._TargetWeight = weight;
-		}
-		else
-		{
-			i.second._TargetWeight = 0;
-		}
+		i._TargetWeight = 0;
+	}
+
+	Blend const & b = _BlendStates[State];
+	for(size_t i = 0; i < b._Handles.size(); ++i)
+	{
+		Animations[b._Handles[i]]._TargetWeight = b._Weights[i];
+	}
+}
+
+// The target weights set by hand are not those of a blend state: the next
+// SetBlendState() sets them again even if the state is the same
+void CharacterAnimation::SetAnimation(Handle Anim, float weight)
+{
+	_CurrentBlendState = -1;
+
+	for(size_t i = 0; i < Animations.size(); ++i)
+	{
+		Animations[i]._TargetWeight = (int)i == Anim ? weight : 0;
 	}
 }
 
 void CharacterAnimation::ClearAnimations(void )
 {
+	_CurrentBlendState = -1;
+
 	BOOST_FOREACH(auto & i, Animations)
 	{
-		i.second._TargetWeight = 0;
+		i._TargetWeight = 0;
 	}
 }
 
-void CharacterAnimation::SetFadeSpeed(std::string AnimName, float FadeInSpeed, float FadeOutSpeed)
+void CharacterAnimation::SetFadeSpeed(Handle Anim, float FadeInSpeed, float FadeOutSpeed)
 {
-	AnimationMap::iterator it = Animations.find(AnimName);
-	if (it == Animations.end()) return; //throw std::out_of_range(AnimName + " out of range");
+	if (Anim == InvalidHandle) return;
 
-	it->second._FadeInSpeed = FadeInSpeed;
-	it->second._FadeOutSpeed = FadeOutSpeed;
+	Animations[Anim]._FadeInSpeed = FadeInSpeed;
+	Animations[Anim]._FadeOutSpeed = FadeOutSpeed;
 }
 
-void CharacterAnimation::SetSpeed(std::string AnimName, float Speed)
+void CharacterAnimation::SetSpeed(Handle Anim, float Speed)
 {
-	AnimationMap::iterator it = Animations.find(AnimName);
-	if (it == Animations.end()) return; //throw std::out_of_range(AnimName + " out of range");
+	if (Anim == InvalidHandle) return;
 
-	it->second._Speed = Speed;
+	Animations[Anim]._Speed = Speed;
 }
 
-float CharacterAnimation::GetLength(std::string AnimName)
+float CharacterAnimation::GetLength(Handle Anim)
 {
-	AnimationMap::iterator it = Animations.find(AnimName);
-	if (it == Animations.end()) return 0; //throw std::out_of_range(AnimName + " out of range");
+	if (Anim == InvalidHandle) return 0;
 	
-	return it->second._as->getLength();
+	return Animations[Anim]._as->getLength();
 }
 
-void CharacterAnimation::SetTime(std::string AnimName, float t)
+void CharacterAnimation::SetTime(Handle Anim, float t)
 {
-	AnimationMap::iterator it = Animations.find(AnimName);
-	if (it == Animations.end()) return; //throw std::out_of_range(AnimName + " out of range");
+	if (Anim == InvalidHandle) return;
 	
-	it->second._as->setTimePosition(t);
+	Animations[Anim]._as->setTimePosition(t);
 }
 
-void CharacterAnimation::PushAnimation(std::string AnimName, float weight)
+void CharacterAnimation::PushAnimation(Handle Anim, float weight)
 {
-	AnimationMap::iterator it = Animations.find(AnimName);
-	if (it == Animations.end()) return; //throw std::out_of_range(AnimName + " out of range");
+	if (Anim == InvalidHandle) return;
 
-	it->second._TargetWeight = weight;
+	_CurrentBlendState = -1;
+	Animations[Anim]._TargetWeight = weight;
 }
 
-void CharacterAnimation::SetWeight(std::string AnimName, float weight)
+void CharacterAnimation::SetWeight(Handle Anim, float weight)
 {
-	AnimationMap::iterator it = Animations.find(AnimName);
-	if (it == Animations.end()) return; //throw std::out_of_range(AnimName + " out of range");
+	if (Anim == InvalidHandle) return;
 
-	it->second._as->setWeight(weight);
+	AnimState & a = Animations[Anim];
+	a._Weight = weight;
+	a._as->setEnabled(weight > 0);
+	a._as->setWeight(weight);
 }
 
 void CharacterAnimation::Update(float dt)
 {
-	BOOST_FOREACH(auto & i, Animations)
+	for(size_t i = 0; i < Animations.size(); ++i)
 	{
-		float CurWeight = i.second._as->getWeight();
-		if (CurWeight > i.second._TargetWeight)
+		AnimState & a = Animations[i];
+
+		// Ogre's state is only touched when it changes: the animations
+		// faded out keep their time position until they are played again
+		if (a._Weight == 0 && a._TargetWeight == 0)
+			continue;
+
+		float CurWeight = a._Weight;
+		if (CurWeight > a._TargetWeight)
 		{
-			CurWeight -= i.second._FadeOutSpeed * dt;
-			if (CurWeight < i.second._TargetWeight)
-				CurWeight = i.second._TargetWeight;
+			CurWeight -= a._FadeOutSpeed * dt;
+			if (CurWeight < a._TargetWeight)
+				CurWeight = a._TargetWeight;
 		}
-		else if (CurWeight < i.second._TargetWeight)
+		else if (CurWeight < a._TargetWeight)
 		{
-			CurWeight += i.second._FadeInSpeed * dt;
-			if (CurWeight > i.second._TargetWeight)
-				CurWeight = i.second._TargetWeight;
+			CurWeight += a._FadeInSpeed * dt;
+			if (CurWeight > a._TargetWeight)
+				CurWeight = a._TargetWeight;
 		}
-		
-		i.second._as->setEnabled(CurWeight > 0);
-		i.second._as->setWeight(CurWeight);
-		i.second._as->addTime(dt * i.second._Speed);
+
+		if (CurWeight != a._Weight)
+		{
+			a._Weight = CurWeight;
+			a._as->setEnabled(CurWeight > 0);
+			a._as->setWeight(CurWeight);
+		}
+
+		if (CurWeight > 0)
+			a._as->addTime(dt * a._Speed);
 	}
-}
 
+	// An entity only updates its skeleton when it is rendered
+	if (_Skeleton)
+		_Skeleton->setAnimationState(*_States);
+}
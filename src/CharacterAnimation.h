@@ -18,51 +18,93 @@
 #ifndef CHARACTERANIMATION_H
 #define CHARACTERANIMATION_H
 
-#include <map>
+#include <memory>
 #include <string>
+#include <vector>
+
+#include <OgreMesh.h>
 
 namespace Ogre
 {
 	class AnimationState;
+	class AnimationStateSet;
+	class SkeletonInstance;
 	class Entity;
 }
 
+// The animations are looked up by name once, into handles indexing a flat
+// array of states which Update() goes through in order. An unknown name
+// gives InvalidHandle, which the other methods ignore.
+//
+// Blend states are sets of animations played together: SetBlendState()
+// fades them in and every other animation out, and does nothing while the
+// state does not change. Setting the weights by hand leaves the state.
 class CharacterAnimation
 {
+public:
+	typedef int Handle;
+	typedef int BlendState;
+	static const Handle InvalidHandle = -1;
+
 private:
 	struct AnimState
 	{
 		Ogre::AnimationState * _as;
+		float _Weight;
 		float _TargetWeight;
 		float _FadeInSpeed;
 		float _FadeOutSpeed;
 		float _Speed;
 		AnimState(Ogre::AnimationState* AnimState, float TargetWeight, float FadeInSpeed, float FadeOutSpeed, float Speed) :
 			_as(AnimState),
+			_Weight(0),
 			_TargetWeight(TargetWeight),
 			_FadeInSpeed(FadeInSpeed),
 			_FadeOutSpeed(FadeOutSpeed),
 			_Speed(Speed) {}
 	};
-	
-	typedef std::map<std::string, AnimState> AnimationMap;
-	
-	AnimationMap Animations;
+
+	struct Blend
+	{
+		std::vector<Handle> _Handles;
+		std::vector<float> _Weights;
+	};
+
+	std::vector<AnimState> Animations;
+	std::vector<Blend> _BlendStates;
+	BlendState _CurrentBlendState;
+
+	// Only without an entity
+	std::unique_ptr<Ogre::SkeletonInstance> _Skeleton;
+	std::unique_ptr<Ogre::AnimationStateSet> _States;
+
+	CharacterAnimation(CharacterAnimation const &);
+	CharacterAnimation & operator=(CharacterAnimation const &);
 	
 public:
-	CharacterAnimation(Ogre::Entity * ent);
-	
-	void SetAnimation(std::string AnimName, float weight = 1);
+	// The animation states of the entity are used. Without an entity
+	// (headless), a skeleton instance of the mesh is animated instead, and
+	// its bones are updated by Update().
+	CharacterAnimation(Ogre::Entity * ent, Ogre::MeshPtr const & mesh);
+	~CharacterAnimation();
+
+	Handle Find(std::string const & AnimName) const;
+
+	BlendState AddBlendState();
+	void AddToBlendState(BlendState State, Handle Anim, float weight = 1);
+	void SetBlendState(BlendState State);
+
+	void SetAnimation(Handle Anim, float weight = 1);
 	void ClearAnimations(void);
-	void PushAnimation(std::string AnimName, float weight = 1);
-	void SetWeight(std::string AnimName, float weight);
+	void PushAnimation(Handle Anim, float weight = 1);
+	void SetWeight(Handle Anim, float weight);
 	
-	void SetFadeSpeed(std::string AnimName, float FadeInSpeed, float FadeOutSpeed);
-	void SetSpeed(std::string AnimName, float Speed);
+	void SetFadeSpeed(Handle Anim, float FadeInSpeed, float FadeOutSpeed);
+	void SetSpeed(Handle Anim, float Speed);
 	void Update(float dt);
 
-	float GetLength(std::string AnimName);
-	void SetTime(std::string AnimName, float t);
+	float GetLength(Handle Anim);
+	void SetTime(Handle Anim, float t);
 };
 
 #endif // CHARACTERANIMATION_H
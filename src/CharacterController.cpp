@@ -20,8 +20,22 @@
 #include "pmd.h"
 #include "DebugDrawer.h"
 
+#include <OGRE/OgreCamera.h>
 #include <OGRE/OgreSceneManager.h>
 #include <OGRE/OgreEntity.h>
+#include <OGRE/OgreMeshManager.h>
+
+// Animation levels of detail: distances to the camera in metres, and
+// frames per update of a reduced animation
+const float AnimationFullDistance = 20;
+const float AnimationFrozenDistance = 80;
+const int AnimationReducedRate = 4;
+
+// Distance in metres at which a corner of the path counts as reached
+const float PathCornerDistance = 0.2;
+
+// Characters created, to spread the updates of the reduced animations
+static int CharacterCount = 0;
 
 CharacterController::CharacterController(
 	Ogre::SceneManager *               SceneMgr,
@@ -37,14 +51,20 @@ CharacterController::CharacterController(
 	_TargetVelocity(0, 0, 0),
 	_Jump(false),
 	_GroundContact(false),
+	_AllowSleep(true),
+	_Node(0),
 	_MotionState(
-		Ogre::Quaternion::IDENTITY,
-		Ogre::Vector3::ZERO,
+		Ogre::Quaternion(Ogre::Radian(Heading), Ogre::Vector3::UNIT_Y),
+		Ogre::Vector3(Position.x(), Position.y(), Position.z()),
 		Ogre::Vector3(0, Height / 2, 0),
 		0),
-	_Entity(SceneMgr->createEntity(MeshName)),
-	_MeshSize(_Entity->getBoundingBox().getMaximum() - _Entity->getBoundingBox().getMinimum()),
-	_MeshCenter((_Entity->getBoundingBox().getMaximum() + _Entity->getBoundingBox().getMinimum()) / 2),
+	_Entity(SceneMgr ? SceneMgr->createEntity(MeshName) : 0),
+	// The bounds of the mesh are used without an entity, so that the
+	// shape of the character is the same in headless mode
+	_Mesh(Ogre::MeshManager::getSingleton().load(MeshName, Ogre::ResourceGroupManager::AUTODETECT_RESOURCE_GROUP_NAME)),
+	_MeshBounds(_Mesh->getBounds()),
+	_MeshSize(_MeshBounds.getMaximum() - _MeshBounds.getMinimum()),
+	_MeshCenter((_MeshBounds.getMaximum() + _MeshBounds.getMinimum()) / 2),
 	_Scale(Height / _MeshSize.y),
 	_Radius(std::max(_MeshSize.x, _MeshSize.z) / 2),
 	/*_Shape(btVector3(
@@ -59,25 +79,37 @@ CharacterController::CharacterController(
 	_Mass(Mass),
 	_Body(_Mass, &_MotionState, &_Shape, btVector3(0, 0, 0)),
 	_World(World),
-	_Animations(_Entity),
+	_Animations(_Entity, _Mesh),
 	_IdleTime(0),
 	_CoG(0, Height / 2, 0),
+	_ShownGroundContact(false),
+	_ShownSpeed(0),
+	_ShownIdleTime(0),
+	_AnimationLod(AnimationFull),
+	_AnimationTime(0),
+	_AnimationFrame(CharacterCount++ % AnimationReducedRate),
+	_PendingPathRevision(0),
+	_CrowdAgent(-1),
 	_CurrentPathIndex(0),
 	_CurrentPathAge(FLT_MAX),
 	_HitPoints(InitialHitPoints)
 {
-	_Node = SceneMgr->getRootSceneNode()->createChildSceneNode(
-		Ogre::Vector3(Position.x(), Position.y(), Position.z()),
-		Ogre::Quaternion(Ogre::Radian(Heading), Ogre::Vector3::UNIT_Y));
-
-	Ogre::SceneNode * entnode = _Node->createChildSceneNode(
-		Ogre::Vector3(
-			-_MeshCenter.x * _Scale,
-			-_Entity->getBoundingBox().getMinimum().y * _Scale,
-			-_MeshCenter.z * _Scale));
-
-	entnode->scale(_Scale, _Scale, _Scale);
-	entnode->attachObject(_Entity);
+	// Without a scene manager (headless), the character only has a body
+	if (SceneMgr)
+	{
+		_Node = SceneMgr->getRootSceneNode()->createChildSceneNode(
+			Ogre::Vector3(Position.x(), Position.y(), Position.z()),
+			Ogre::Quaternion(Ogre::Radian(Heading), Ogre::Vector3::UNIT_Y));
+
+		Ogre::SceneNode * entnode = _Node->createChildSceneNode(
+			Ogre::Vector3(
+				-_MeshCenter.x * _Scale,
+				-_MeshBounds.getMinimum().y * _Scale,
+				-_MeshCenter.z * _Scale));
+
+		entnode->scale(_Scale, _Scale, _Scale);
+		entnode->attachObject(_Entity);
+	}
 
 	_Body.setCenterOfMassTransform(btTransform(btQuaternion(btVector3(0, 1, 0), Heading), Position + btVector3(0, _CoG.y, 0)));
 	_CurrentHeading = Heading;
@@ -86,19 +118,55 @@ CharacterController::CharacterController(
 
 	World->addRigidBody(&_Body);
 
-	_Animations.SetWeight("IdleTop", 1);
-	_Animations.SetWeight("IdleBase", 1);
+	_RunBase = _Animations.Find("RunBase");
+	_RunTop = _Animations.Find("RunTop");
+	const CharacterAnimation::Handle IdleBase = _Animations.Find("IdleBase");
+	const CharacterAnimation::Handle IdleTop = _Animations.Find("IdleTop");
+
+	_Jumping = _Animations.AddBlendState();
+	_Animations.AddToBlendState(_Jumping, _Animations.Find("JumpLoop"));
+
+	_Running = _Animations.AddBlendState();
+	_Animations.AddToBlendState(_Running, _RunBase);
+	_Animations.AddToBlendState(_Running, _RunTop);
+	_Animations.AddToBlendState(_Running, _Animations.Find("my_animation"));
+
+	_Idle = _Animations.AddBlendState();
+	_Animations.AddToBlendState(_Idle, IdleBase);
+	_Animations.AddToBlendState(_Idle, IdleTop);
+
+	_Dancing = _Animations.AddBlendState();
+	_Animations.AddToBlendState(_Dancing, _Animations.Find("Dance"));
+
+	// Idle from the start, without fading in
+	_Animations.SetBlendState(_Idle);
+	_Animations.SetWeight(IdleTop, 1);
+	_Animations.SetWeight(IdleBase, 1);
 }
 
 CharacterController::~CharacterController(void)
 {
 	_World->removeRigidBody(&_Body);
 
-	_Node->getParentSceneNode()->removeChild(_Node->getName());
+	if (_Node)
+		_Node->getParentSceneNode()->removeChild(_Node->getName());
 }
 
-void CharacterController::UpdatePhysics(btScalar dt)
+void CharacterController::UpdatePhysics(btScalar dt, ContactIndex const & contacts)
 {
+	// Below this target speed, the character is left to Bullet, which puts
+	// it to sleep once it has stopped
+	const btScalar SleepVelocity = 0.1;
+	const bool Stopped = _TargetVelocity.length2() < SleepVelocity * SleepVelocity;
+
+	// A sleeping character is not updated until it has to move, or Bullet
+	// wakes it up because something hit it. It keeps its ground contact.
+	if (_AllowSleep && Stopped && !_Jump && !_Body.isActive())
+	{
+		_IdleTime += dt;
+		return;
+	}
+
 	bool IsIdle = true;
 	btVector3 CurrentVelocity = _Body.getLinearVelocity();
 
@@ -135,33 +203,32 @@ void CharacterController::UpdatePhysics(btScalar dt)
 	F.setY(0);
 
 	// Update collision status
-	int numManifolds = _World->getDispatcher()->getNumManifolds();
 	_GroundContact = false;
-	for(int i=0;i<numManifolds;i++)
+	std::pair<ContactIndex::iterator, ContactIndex::iterator> manifolds = contacts.GetManifolds(&_Body);
+	for(ContactIndex::iterator i = manifolds.first; i != manifolds.second; ++i)
 	{
-		btPersistentManifold* contactManifold =  _World->getDispatcher()->getManifoldByIndexInternal(i);
+		btPersistentManifold* contactManifold = i->second;
 
-		if (contactManifold->getBody0() == &_Body || contactManifold->getBody1() == &_Body)
+		int numContacts = contactManifold->getNumContacts();
+		for(int contact=0; contact < numContacts; contact++)
 		{
-			int numContacts = contactManifold->getNumContacts();
-			for(int contact=0; contact < numContacts; contact++)
+			btManifoldPoint& pt = contactManifold->getContactPoint(contact);
+			if (pt.getDistance() < 0.1f)
 			{
-				btManifoldPoint& pt = contactManifold->getContactPoint(contact);
-				if (pt.getDistance() < 0.1f)
+				const btVector3& normalOnB = pt.m_normalWorldOnB;
+				if (normalOnB.getY() != 0)
 				{
-					const btVector3& normalOnB = pt.m_normalWorldOnB;
-					if (normalOnB.getY() != 0)
-					{
-						_GroundContact = true;
-					}
+					_GroundContact = true;
 				}
 			}
 		}
 	}
 
+	bool Jumped = false;
 	if (_Jump && _GroundContact)
 	{
 		_Jump = false;
+		Jumped = true;
 
 		btVector3 Velocity = _Body.getLinearVelocity();
 		Velocity.setY(9);
@@ -171,64 +238,145 @@ void CharacterController::UpdatePhysics(btScalar dt)
 	if (!_GroundContact)
 		IsIdle = false;
 
-	_Body.activate(true);
+	if (!_AllowSleep || !Stopped || Jumped || !_GroundContact)
+		_Body.activate(true);
 	_Body.applyCentralForce(F);
 
 	_IdleTime = IsIdle ? _IdleTime + dt : 0;
 }
 
+void CharacterController::PublishState(bool Ticked, float Alpha)
+{
+	_ShownGroundContact = _GroundContact;
+	_ShownSpeed = _TargetVelocity.length();
+	_ShownIdleTime = _IdleTime;
+
+	_MotionState.publish(Ticked, Alpha);
+}
+
+void CharacterController::UpdateAnimationLod(Ogre::Camera const & Camera)
+{
+	const Ogre::Vector3 Centre = _MotionState.getShownPosition() + _CoG;
+	const float Distance2 = Camera.getDerivedPosition().squaredDistance(Centre);
+
+	if (!Camera.isVisible(Ogre::Sphere(Centre, _Scale * _MeshSize.length() / 2)))
+		_AnimationLod = AnimationHidden;
+	else if (Distance2 < AnimationFullDistance * AnimationFullDistance)
+		_AnimationLod = AnimationFull;
+	else if (Distance2 < AnimationFrozenDistance * AnimationFrozenDistance)
+		_AnimationLod = AnimationReduced;
+	else
+		_AnimationLod = AnimationFrozen;
+}
+
 void CharacterController::UpdateGraphics(float dt)
 {
-	_Animations.ClearAnimations();
+	_AnimationTime += dt;
 
-	if (!_GroundContact)
+	switch(_AnimationLod)
 	{
-		_Animations.PushAnimation("JumpLoop");
+	case AnimationFull:
+		break;
+
+	case AnimationReduced:
+		_AnimationFrame = (_AnimationFrame + 1) % AnimationReducedRate;
+		if (_AnimationFrame)
+			return;
+		break;
+
+	// Outside the view, Ogre does not update the skeleton either
+	case AnimationFrozen:
+	case AnimationHidden:
+		return;
 	}
-	else if (_TargetVelocity.length2() > 0)
+
+	if (!_ShownGroundContact)
 	{
-		_Animations.SetSpeed("RunBase", _TargetVelocity.length() / 10);
-		_Animations.SetSpeed("RunTop", _TargetVelocity.length() / 10);
-		_Animations.PushAnimation("RunBase");
-		_Animations.PushAnimation("RunTop");
-		_Animations.PushAnimation("my_animation");
+		_Animations.SetBlendState(_Jumping);
+	}
+	else if (_ShownSpeed > 0)
+	{
+		_Animations.SetSpeed(_RunBase, _ShownSpeed / 10);
+		_Animations.SetSpeed(_RunTop, _ShownSpeed / 10);
+		_Animations.SetBlendState(_Running);
 	}
 	else
 	{
-		if (_IdleTime < 5)
+		// Idle for 5 s, then dancing for 10 s, and again: the idle time
+		// belongs to the physics and is not reset here
+		const float IdleTime = fmod(_ShownIdleTime, 15);
+
+		_Animations.SetBlendState(IdleTime < 5 ? _Idle : _Dancing);
+	}
+
+	_Animations.Update(_AnimationTime);
+	_AnimationTime = 0;
+}
+
+void CharacterController::UpdateAITarget(const Ogre::Vector3& target, Pathfinding::PathScheduler & scheduler, float velocity)
+{
+	if (_PendingPath)
+	{
+		// Follow the partial path while the scheduler is still working on
+		// it. Each replacement starts where the path was requested, so the
+		// corners the character has passed since are skipped.
+		if (_PendingPath->GetStatus() != Pathfinding::PathScheduler::Queued && _PendingPath->GetRevision() != _PendingPathRevision)
 		{
-			_Animations.PushAnimation("IdleBase");
-			_Animations.PushAnimation("IdleTop");
+			_PendingPathRevision = _PendingPath->GetRevision();
+			_CurrentPath = _PendingPath->GetPath();
+			_CurrentPathIndex = _CurrentPath.NextCorner(GetPosition(), 1, PathCornerDistance) - 1;
 		}
-		else if (_IdleTime < 15)
+
+		if (_PendingPath->Done())
 		{
-			_Animations.SetAnimation("Dance");
+			_Corridor->SetPath(_PendingPath->GetPath());
+			_PendingPath.reset();
+		}
+	}
+
+	if (!_PendingPath && (target.squaredDistance(_CurrentTarget) > 0.001 || _CurrentPathAge > 0.1))
+	{
+		if (!_Corridor)
+			_Corridor.reset(new Pathfinding::PathCorridor(scheduler.GetNavMesh()));
+
+		// Patch the corridor from the last query, and only query again if
+		// it cannot follow the agent or the target
+		if (_Corridor->MovePosition(GetPosition()) && _Corridor->MoveTarget(target) && _Corridor->IsValid())
+		{
+			_CurrentPath = _Corridor->GetPath();
+			_CurrentPathIndex = 0;
 		}
 		else
 		{
-			_Animations.PushAnimation("IdleBase");
-			_Animations.PushAnimation("IdleTop");
-			_IdleTime = 0;
+			_PendingPath = scheduler.Submit(GetPosition(), target);
+			_PendingPathRevision = 0;
 		}
+
+		_CurrentPathAge = 0;
+		_CurrentTarget = target;
+		_CurrentVelocity = velocity;
 	}
+}
 
-	_Animations.Update(dt);
+void CharacterController::JoinCrowd(Pathfinding::Crowd & crowd, float velocity)
+{
+	_CrowdAgent = crowd.Add(GetPosition(), _Scale * _Radius, velocity);
 }
 
-void CharacterController::UpdateAITarget(const Ogre::Vector3& target, std::shared_ptr< Environment > env, float velocity)
+void CharacterController::UpdateCrowdState(Pathfinding::Crowd & crowd)
 {
-	if (target.squaredDistance(_CurrentTarget) > 0.001 || _CurrentPathAge > 0.1)
-	{
-		//boost::posix_time::ptime t1 = boost::posix_time::microsec_clock::universal_time();
-		_CurrentPath = env->QueryPath(GetPosition(), target);
-		//boost::posix_time::ptime t2 = boost::posix_time::microsec_clock::universal_time();
-		_CurrentPathIndex = 0;
-		_CurrentTarget = target;
-		_CurrentVelocity = velocity;
-		//std::cerr << "Pathfinding in " << (t2-t1).total_microseconds() << " µs\n";
-	}
+	btVector3 const & v = _Body.getLinearVelocity();
+	crowd.SetState(_CrowdAgent, GetPosition(), Ogre::Vector3(v.x(), v.y(), v.z()));
 }
 
+void CharacterController::FollowCrowd(Pathfinding::Crowd const & crowd)
+{
+	SetVelocity(crowd.GetVelocity(_CrowdAgent));
+
+	// Only kept for DebugDrawAI()
+	_CurrentPath = crowd.GetPath(_CrowdAgent);
+	_CurrentPathIndex = 0;
+}
 
 void CharacterController::UpdateAI(float dt)
 {
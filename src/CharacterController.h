@@ -26,23 +26,32 @@
 
 #include <OGRE/OgreVector3.h>
 #include <OGRE/OgreSceneNode.h>
+#include <OGRE/OgreAxisAlignedBox.h>
 
 #include "RigidBody.h"
 #include "CharacterAnimation.h"
+#include "ContactIndex.h"
 #include "Pathfinding/Pathfinding.h"
+#include "Pathfinding/PathCorridor.h"
+#include "Pathfinding/Crowd.h"
 
 #include <memory>
-#include "environment.h"
 #include "DebugDrawer.h"
 
 namespace Ogre
 {
+	class Camera;
 	class Entity;
 }
 
 class CharacterController
 {
 public:
+	// Allocated as Bullet allocates btRigidBody: with SSE, _Body asks for
+	// 64 byte alignment, which new does not give, but only needs 16
+	BT_DECLARE_ALIGNED_ALLOCATOR();
+
+	// SceneMgr may be null, the character is then not displayed
 	CharacterController(
 		Ogre::SceneManager *               SceneMgr,
 		std::shared_ptr<btDynamicsWorld>   World,
@@ -54,7 +63,35 @@ public:
 		float                              InitialHitPoints);
 	~CharacterController();
 
-	void UpdatePhysics(btScalar dt);
+	// The contacts of the body are looked up in the index of the tick
+	void UpdatePhysics(btScalar dt, ContactIndex const & contacts);
+
+	// Copies the state of the last tick used by UpdateGraphics(), and
+	// places the node between the last two ticks (see RigidBody::publish),
+	// while the world is not stepped. UpdateGraphics() may then run while
+	// the next ticks are simulated.
+	void PublishState(bool Ticked, float Alpha);
+
+	// Level of detail of the animation: every frame near the camera, every
+	// few frames farther, not at all far away or outside the view. The
+	// time of the frames skipped is given to the animation states at the
+	// next update, so that their fades and time positions stay the same as
+	// if they had been updated. Full until set.
+	enum AnimationLod
+	{
+		AnimationFull,
+		AnimationReduced,
+		AnimationFrozen,
+		AnimationHidden
+	};
+
+	// From the position given by PublishState(), on the thread of the
+	// camera
+	void UpdateAnimationLod(Ogre::Camera const & Camera);
+	AnimationLod GetAnimationLod() const
+	{
+		return _AnimationLod;
+	}
 	void UpdateGraphics(float dt);
 	void SetVelocity(Ogre::Vector3 Velocity)
 	{
@@ -68,9 +105,25 @@ public:
 	{
 		_Jump = _GroundContact;
 	}
+	// A character standing still on the ground may be deactivated by
+	// Bullet, it is woken up when its target velocity is set or when it is
+	// hit. Enabled by default.
+	void SetAllowSleep(bool AllowSleep)
+	{
+		_AllowSleep = AllowSleep;
+	}
+	bool IsSleeping(void) const
+	{
+		return !_Body.isActive();
+	}
 	Ogre::Vector3 GetPosition()
 	{
-		return _Node->getPosition();
+		return _MotionState.getPosition();
+	}
+	// Position of the node, given by PublishState()
+	Ogre::Vector3 GetShownPosition()
+	{
+		return _MotionState.getShownPosition();
 	}
 	float GetHeading(void)
 	{
@@ -83,7 +136,21 @@ public:
 
 	void Damage(float DamagePoints);
 
-	void UpdateAITarget(Ogre::Vector3 const & target, std::shared_ptr<Environment> env, float velocity);
+	// Steering on its own along a path corridor. The game steers the
+	// enemies as a crowd: UpdateAITarget() and UpdateAI() are only used by
+	// bench_horde --corridor, to compare both.
+	void UpdateAITarget(Ogre::Vector3 const & target, Pathfinding::PathScheduler & scheduler, float velocity);
+
+	// Steering by a crowd: the state of the body is given to the crowd
+	// before it is updated, and its velocity is followed after
+	void JoinCrowd(Pathfinding::Crowd & crowd, float velocity);
+	void UpdateCrowdState(Pathfinding::Crowd & crowd);
+	void FollowCrowd(Pathfinding::Crowd const & crowd);
+	Pathfinding::Crowd::AgentRef GetCrowdAgent() const
+	{
+		return _CrowdAgent;
+	}
+	// Follows the path of UpdateAITarget()
 	void UpdateAI(float dt);
 	void DebugDrawAI(DebugDrawer & dd);
 
@@ -93,10 +160,13 @@ private:
 	btVector3                          _TargetVelocity;
 	bool                               _Jump;
 	bool                               _GroundContact;
+	bool                               _AllowSleep;
 
 	Ogre::SceneNode *                  _Node;
 	RigidBody<Ogre::SceneNode>         _MotionState;
 	Ogre::Entity *                     _Entity;
+	Ogre::MeshPtr                      _Mesh;
+	Ogre::AxisAlignedBox               _MeshBounds;
 	Ogre::Vector3                      _MeshSize;
 	Ogre::Vector3                      _MeshCenter;
 	float                              _Scale;
@@ -110,11 +180,36 @@ private:
 
 	CharacterAnimation                 _Animations;
 
+	// Resolved when the character is created
+	CharacterAnimation::Handle         _RunBase;
+	CharacterAnimation::Handle         _RunTop;
+	CharacterAnimation::BlendState     _Jumping;
+	CharacterAnimation::BlendState     _Running;
+	CharacterAnimation::BlendState     _Idle;
+	CharacterAnimation::BlendState     _Dancing;
+
 	float                              _IdleTime;
 	Ogre::Vector3                      _CoG;
 
+	// State of the last tick, copied by PublishState() for UpdateGraphics()
+	bool                               _ShownGroundContact;
+	float                              _ShownSpeed;
+	float                              _ShownIdleTime;
+
+	AnimationLod                       _AnimationLod;
+	// Time not given to the animation states yet
+	float                              _AnimationTime;
+	// Frames counted by a reduced animation, starting at a different
+	// value for each character so that they are not all updated together
+	int                                _AnimationFrame;
+
 	Ogre::Vector3                      _CurrentTarget;
 	Pathfinding::NavMesh::Path         _CurrentPath;
+	Pathfinding::PathScheduler::RequestPtr _PendingPath;
+	// Revision of the path of _PendingPath in _CurrentPath
+	int                                _PendingPathRevision;
+	std::unique_ptr<Pathfinding::PathCorridor> _Corridor;
+	Pathfinding::Crowd::AgentRef       _CrowdAgent;
 	size_t                             _CurrentPathIndex;
 	float                              _CurrentPathAge;
 	float                              _CurrentVelocity;
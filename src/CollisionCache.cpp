@@ -0,0 +1,251 @@
+/*
+    Copyright (C) 2011  Patrick Nicolas <patricknicolas@laposte.net>
+    Copyright (C) 2011-2012  Guillaume Meunier <guillaume.meunier@centraliens.net>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, version 3 of the License.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include "CollisionCache.h"
+
+#include <boost/interprocess/file_mapping.hpp>
+
+#include <fstream>
+#include <vector>
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+
+// File layout: CacheHeader, vertices, triangle indices, serialized BVH and
+// internal edge infos, each block starting on 16 bytes
+static const char cachemagic[4] = { 'P', 'M', 'D', 'C' };
+static const int cacheversion = 1;
+static const size_t cachealign = 16;
+
+struct CacheHeader
+{
+	char magic[4];
+	int version;
+	uint64_t key;
+
+	int numVertices;
+	int vertexStride;
+	int vertexType;
+	int numTriangles;
+	int triangleIndexStride;
+	int indexType;
+
+	unsigned int bvhSize;
+
+	int numTriangleInfos;
+	btScalar convexEpsilon;
+	btScalar planarEpsilon;
+	btScalar equalVertexThreshold;
+	btScalar edgeDistanceThreshold;
+	btScalar maxEdgeAngleThreshold;
+	btScalar zeroAreaThreshold;
+};
+
+struct CacheTriangleInfo
+{
+	int key;
+	btTriangleInfo info;
+};
+
+static size_t align(size_t offset)
+{
+	return (offset + cachealign - 1) & ~(cachealign - 1);
+}
+
+CollisionCache::CollisionCache() : _Bvh(0)
+{
+}
+
+CollisionCache::~CollisionCache()
+{
+	// The BVH lives in the mapping and does not own its arrays
+	_Shape.reset();
+	if (_Bvh)
+		_Bvh->~btOptimizedBvh();
+}
+
+void CollisionCache::Save(std::string const & filename, uint64_t key, btBvhTriangleMeshShape & shape)
+{
+	const btStridingMeshInterface & mesh = *shape.getMeshInterface();
+	btOptimizedBvh * bvh = shape.getOptimizedBvh();
+	const btTriangleInfoMap * infomap = shape.getTriangleInfoMap();
+
+	if (mesh.getNumSubParts() != 1 || !bvh || !bvh->isQuantized())
+		throw std::runtime_error("Cannot cache collision shape " + filename);
+
+	CacheHeader header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, cachemagic, sizeof(cachemagic));
+	header.version = cacheversion;
+	header.key = key;
+
+	const unsigned char * vertices;
+	const unsigned char * indices;
+	PHY_ScalarType vertexType, indexType;
+	mesh.getLockedReadOnlyVertexIndexBase(&vertices, header.numVertices, vertexType, header.vertexStride,
+		&indices, header.triangleIndexStride, header.numTriangles, indexType, 0);
+	header.vertexType = vertexType;
+	header.indexType = indexType;
+
+	std::vector<unsigned char> bvhdata(bvh->calculateSerializeBufferSize() + cachealign);
+	unsigned char * bvhbuffer = (unsigned char *)align((size_t)&bvhdata[0]);
+	header.bvhSize = bvh->calculateSerializeBufferSize();
+	bvh->serializeInPlace(bvhbuffer, header.bvhSize, false);
+
+	// The info map has no public access to its keys, but they are the
+	// triangle indices for a single part mesh
+	std::vector<CacheTriangleInfo> infos;
+	if (infomap)
+	{
+		for(int i = 0; i < header.numTriangles; ++i)
+		{
+			const btTriangleInfo * info = infomap->find(btHashInt(i));
+			if (info)
+			{
+				CacheTriangleInfo item;
+				item.key = i;
+				item.info = *info;
+				infos.push_back(item);
+			}
+		}
+
+		header.numTriangleInfos = infos.size();
+		header.convexEpsilon = infomap->m_convexEpsilon;
+		header.planarEpsilon = infomap->m_planarEpsilon;
+		header.equalVertexThreshold = infomap->m_equalVertexThreshold;
+		header.edgeDistanceThreshold = infomap->m_edgeDistanceThreshold;
+		header.maxEdgeAngleThreshold = infomap->m_maxEdgeAngleThreshold;
+		header.zeroAreaThreshold = infomap->m_zeroAreaThreshold;
+	}
+	else
+	{
+		header.numTriangleInfos = -1;
+	}
+
+	// Write to a temporary file so that a partial file is never loaded
+	const std::string tmpname = filename + ".tmp";
+	std::ofstream out(tmpname.c_str(), std::ios::binary | std::ios::trunc);
+	if (!out)
+	{
+		mesh.unLockReadOnlyVertexBase(0);
+		throw std::runtime_error("Cannot write collision cache " + tmpname);
+	}
+
+	const char padding[cachealign] = { 0 };
+	size_t offset = 0;
+	auto write = [&](const void * data, size_t size)
+	{
+		out.write((const char *)data, size);
+		out.write(padding, align(offset + size) - offset - size);
+		offset = align(offset + size);
+	};
+
+	write(&header, sizeof(header));
+	write(vertices, (size_t)header.numVertices * header.vertexStride);
+	write(indices, (size_t)header.numTriangles * header.triangleIndexStride);
+	write(bvhbuffer, header.bvhSize);
+	if (!infos.empty())
+		write(&infos[0], infos.size() * sizeof(CacheTriangleInfo));
+
+	mesh.unLockReadOnlyVertexBase(0);
+
+	out.close();
+	if (!out)
+		throw std::runtime_error("Cannot write collision cache " + tmpname);
+
+	std::remove(filename.c_str());
+	if (std::rename(tmpname.c_str(), filename.c_str()))
+		throw std::runtime_error("Cannot write collision cache " + filename);
+}
+
+std::shared_ptr<CollisionCache> CollisionCache::Load(std::string const & filename, uint64_t key)
+{
+	using namespace boost::interprocess;
+
+	std::shared_ptr<CollisionCache> cache(new CollisionCache);
+
+	// deSerializeInPlace() fixes the pointers of the BVH in the buffer,
+	// the mapping is private so that only the modified pages are copied
+	try
+	{
+		file_mapping file(filename.c_str(), read_only);
+		mapped_region(file, copy_on_write).swap(cache->_Region);
+	}
+	catch(interprocess_exception &)
+	{
+		return std::shared_ptr<CollisionCache>();
+	}
+
+	unsigned char * data = (unsigned char *)cache->_Region.get_address();
+	size_t size = cache->_Region.get_size();
+
+	CacheHeader header;
+	if (size < sizeof(header))
+		return std::shared_ptr<CollisionCache>();
+
+	memcpy(&header, data, sizeof(header));
+	if (memcmp(header.magic, cachemagic, sizeof(cachemagic)) ||
+	    header.version != cacheversion ||
+	    header.key != key)
+		return std::shared_ptr<CollisionCache>();
+
+	size_t vertices = align(sizeof(header));
+	size_t indices = align(vertices + (size_t)header.numVertices * header.vertexStride);
+	size_t bvh = align(indices + (size_t)header.numTriangles * header.triangleIndexStride);
+	size_t infos = align(bvh + header.bvhSize);
+	size_t end = infos + std::max(header.numTriangleInfos, 0) * sizeof(CacheTriangleInfo);
+
+	if (end > size)
+		return std::shared_ptr<CollisionCache>();
+
+	btIndexedMesh mesh;
+	mesh.m_numTriangles = header.numTriangles;
+	mesh.m_triangleIndexBase = data + indices;
+	mesh.m_triangleIndexStride = header.triangleIndexStride;
+	mesh.m_numVertices = header.numVertices;
+	mesh.m_vertexBase = data + vertices;
+	mesh.m_vertexStride = header.vertexStride;
+	mesh.m_vertexType = (PHY_ScalarType)header.vertexType;
+	cache->_Mesh.addIndexedMesh(mesh, (PHY_ScalarType)header.indexType);
+
+	cache->_Bvh = btOptimizedBvh::deSerializeInPlace(data + bvh, header.bvhSize, false);
+	if (!cache->_Bvh)
+		return std::shared_ptr<CollisionCache>();
+
+	cache->_Shape.reset(new btBvhTriangleMeshShape(&cache->_Mesh, true, false));
+	cache->_Shape->setOptimizedBvh(cache->_Bvh);
+
+	if (header.numTriangleInfos >= 0)
+	{
+		btTriangleInfoMap & infomap = cache->_TriangleInfoMap;
+		infomap.m_convexEpsilon = header.convexEpsilon;
+		infomap.m_planarEpsilon = header.planarEpsilon;
+		infomap.m_equalVertexThreshold = header.equalVertexThreshold;
+		infomap.m_edgeDistanceThreshold = header.edgeDistanceThreshold;
+		infomap.m_maxEdgeAngleThreshold = header.maxEdgeAngleThreshold;
+		infomap.m_zeroAreaThreshold = header.zeroAreaThreshold;
+
+		const CacheTriangleInfo * items = (const CacheTriangleInfo *)(data + infos);
+		for(int i = 0; i < header.numTriangleInfos; ++i)
+			infomap.insert(btHashInt(items[i].key), items[i].info);
+
+		cache->_Shape->setTriangleInfoMap(&infomap);
+	}
+
+	return cache;
+}
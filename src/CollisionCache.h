@@ -0,0 +1,67 @@
+/*
+    Copyright (C) 2011  Patrick Nicolas <patricknicolas@laposte.net>
+    Copyright (C) 2011-2012  Guillaume Meunier <guillaume.meunier@centraliens.net>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, version 3 of the License.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+
+#ifndef COLLISIONCACHE_H
+#define COLLISIONCACHE_H
+
+#include <memory>
+#include <string>
+#include <stdint.h>
+
+#include <boost/interprocess/mapped_region.hpp>
+
+#include "bullet/BulletCollision/CollisionShapes/btBvhTriangleMeshShape.h"
+#include "bullet/BulletCollision/CollisionShapes/btTriangleIndexVertexArray.h"
+#include "bullet/BulletCollision/CollisionShapes/btTriangleInfoMap.h"
+
+// Triangles, quantized BVH and internal edge info of a static triangle
+// mesh shape, saved in a file. The triangles and the BVH are used in place
+// from a private mapping of the file, so loading the shape does not
+// rebuild anything.
+class CollisionCache
+{
+public:
+	// Only shapes with a single mesh part and a quantized BVH can be saved.
+	// Throws std::runtime_error if the file cannot be written.
+	static void Save(std::string const & filename, uint64_t key, btBvhTriangleMeshShape & shape);
+
+	// Returns an empty pointer if the file is missing or was written with
+	// another key
+	static std::shared_ptr<CollisionCache> Load(std::string const & filename, uint64_t key);
+
+	~CollisionCache();
+
+	btBvhTriangleMeshShape * GetShape()
+	{
+		return _Shape.get();
+	}
+
+private:
+	CollisionCache();
+	CollisionCache(CollisionCache const &);
+	CollisionCache & operator=(CollisionCache const &);
+
+	boost::interprocess::mapped_region _Region;
+	btTriangleIndexVertexArray _Mesh;
+	btTriangleInfoMap _TriangleInfoMap;
+	btOptimizedBvh * _Bvh;
+	std::unique_ptr<btBvhTriangleMeshShape> _Shape;
+};
+
+#endif // COLLISIONCACHE_H
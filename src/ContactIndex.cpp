@@ -0,0 +1,61 @@
+/*
+    Copyright (C) 2012  Guillaume Meunier <guillaume.meunier@centraliens.net>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, version 3 of the License.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "ContactIndex.h"
+
+#include "bullet/BulletCollision/BroadphaseCollision/btDispatcher.h"
+#include "bullet/BulletCollision/NarrowPhaseCollision/btPersistentManifold.h"
+
+#include <algorithm>
+
+static bool lessBody(std::pair<const btCollisionObject *, btPersistentManifold *> const & a, const btCollisionObject * b)
+{
+	return a.first < b;
+}
+
+static bool lessEntry(std::pair<const btCollisionObject *, btPersistentManifold *> const & a, std::pair<const btCollisionObject *, btPersistentManifold *> const & b)
+{
+	return a.first < b.first;
+}
+
+void ContactIndex::Build(btDispatcher & dispatcher)
+{
+	_Entries.clear();
+
+	const int count = dispatcher.getNumManifolds();
+	for(int i = 0; i < count; ++i)
+	{
+		btPersistentManifold * manifold = dispatcher.getManifoldByIndexInternal(i);
+		if (!manifold->getNumContacts())
+			continue;
+
+		_Entries.push_back(Entry(static_cast<const btCollisionObject *>(manifold->getBody0()), manifold));
+		_Entries.push_back(Entry(static_cast<const btCollisionObject *>(manifold->getBody1()), manifold));
+	}
+
+	// Stable, so that the manifolds of a body stay in the dispatcher order
+	std::stable_sort(_Entries.begin(), _Entries.end(), lessEntry);
+}
+
+std::pair<ContactIndex::iterator, ContactIndex::iterator> ContactIndex::GetManifolds(const btCollisionObject * body) const
+{
+	iterator first = std::lower_bound(_Entries.begin(), _Entries.end(), body, lessBody);
+	iterator last = first;
+	while(last != _Entries.end() && last->first == body)
+		++last;
+
+	return std::make_pair(first, last);
+}
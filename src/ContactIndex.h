@@ -0,0 +1,51 @@
+/*
+    Copyright (C) 2012  Guillaume Meunier <guillaume.meunier@centraliens.net>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, version 3 of the License.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef CONTACTINDEX_H
+#define CONTACTINDEX_H
+
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+class btCollisionObject;
+class btDispatcher;
+class btPersistentManifold;
+
+// Manifolds of the dispatcher sorted by body, built once per tick so that
+// each body finds its own contacts without scanning all the manifolds.
+// Only manifolds with contacts are indexed, the index is invalid once the
+// dispatcher has run again.
+class ContactIndex
+{
+	typedef std::pair<const btCollisionObject *, btPersistentManifold *> Entry;
+	std::vector<Entry> _Entries;
+
+public:
+	typedef std::vector<Entry>::const_iterator iterator;
+
+	void Build(btDispatcher & dispatcher);
+
+	// Range of the entries of the body, the manifold is their second member
+	std::pair<iterator, iterator> GetManifolds(const btCollisionObject * body) const;
+
+	size_t size() const
+	{
+		return _Entries.size();
+	}
+};
+
+#endif // CONTACTINDEX_H
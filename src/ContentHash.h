@@ -0,0 +1,70 @@
+/*
+    Copyright (C) 2011  Patrick Nicolas <patricknicolas@laposte.net>
+    Copyright (C) 2011-2012  Guillaume Meunier <guillaume.meunier@centraliens.net>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, version 3 of the License.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef CONTENTHASH_H
+#define CONTENTHASH_H
+
+#include <string>
+#include <cstdio>
+#include <stdint.h>
+
+// 64 bits FNV-1a hash, used to key the caches of data computed from the
+// level files. Values are hashed with their in-memory representation, so
+// a hash is only meaningful on the machine that computed it.
+class ContentHash
+{
+	uint64_t hash;
+
+public:
+	ContentHash() : hash(14695981039346656037ULL) {}
+
+	void Add(const void * data, size_t size)
+	{
+		const unsigned char * bytes = (const unsigned char *)data;
+		for(size_t i = 0; i < size; ++i)
+		{
+			hash ^= bytes[i];
+			hash *= 1099511628211ULL;
+		}
+	}
+
+	void Add(std::string const & str)
+	{
+		Add(str.data(), str.size());
+		AddValue(str.size());
+	}
+
+	template<typename T> void AddValue(T const & value)
+	{
+		Add(&value, sizeof(value));
+	}
+
+	uint64_t Value() const
+	{
+		return hash;
+	}
+
+	std::string Hex() const
+	{
+		char buffer[17];
+		snprintf(buffer, sizeof(buffer), "%016llx", (unsigned long long)hash);
+		return buffer;
+	}
+};
+
+#endif // CONTENTHASH_H
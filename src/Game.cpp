@@ -24,6 +24,7 @@
 #include "DebugDrawer.h"
 
 #include <stdio.h>
+#include <algorithm>
 #include <OgreEntity.h>
 #include <OgreMeshManager.h>
 #include <boost/foreach.hpp>
@@ -67,7 +68,9 @@ bool Game::keyPressed(const OIS::KeyEvent& e)
 		break;
 
 	case OIS::KC_SPACE:
-		_Player->Jump();
+		// The key is read while the physics may be running, the jump is
+		// given to the player in Update()
+		_JumpPressed = true;
 		break;
 
 	case OIS::KC_F1:
@@ -90,16 +93,8 @@ bool Game::keyPressed(const OIS::KeyEvent& e)
 	return true;
 }
 
-void Game::Update(float TimeSinceLastFrame)
+void Game::UpdateInput(void)
 {
-	if (_Window->isClosed()) return;
-
-	if (_EscPressed)
-	{
-		AppStateManager::Exit();
-		return;
-	}
-
 	float velX = 0, velZ = 0;
 
 	if (_Keyboard->isKeyDown(OIS::KC_Z) || _Keyboard->isKeyDown(OIS::KC_W))
@@ -154,28 +149,30 @@ void Game::Update(float TimeSinceLastFrame)
 	_Camera->setOrientation(
 		Ogre::Quaternion(_Heading, Ogre::Vector3::UNIT_Y) *
 		Ogre::Quaternion(_Pitch, Ogre::Vector3::UNIT_X));
+}
 
-	_World->stepSimulation(TimeSinceLastFrame, 3);
-
-#ifdef PHYSICS_DEBUG
-	_debugDrawer->step();
-#endif
+// Headless mode: the player runs in circles, so that the enemies keep
+// chasing it
+void Game::UpdateScript(float TimeSinceLastFrame)
+{
+	_Heading += Ogre::Radian(0.3 * TimeSinceLastFrame);
 
-	_Player->UpdateGraphics(TimeSinceLastFrame);
-	BOOST_FOREACH(auto & cc, _Enemies)
-	{
-		cc->UpdateGraphics(TimeSinceLastFrame);
-	}
+	_Player->SetVelocity(10 * Ogre::Vector3(sin(_Heading.valueRadians()), 0, cos(_Heading.valueRadians())));
+}
 
+void Game::UpdateCamera(void)
+{
 	btVector3 CamDirection(
 		 cos(_Pitch.valueRadians()) * sin(_Heading.valueRadians()),
 		-sin(_Pitch.valueRadians()),
 		 cos(_Pitch.valueRadians()) * cos(_Heading.valueRadians()));
 
+	// The node of the player, not its body, so that the camera does not
+	// shake between ticks
 	btVector3 Cam1(
-		_Player->GetPosition().x,
-		_Player->GetPosition().y + CameraHeight,
-		_Player->GetPosition().z);
+		_Player->GetShownPosition().x,
+		_Player->GetShownPosition().y + CameraHeight,
+		_Player->GetShownPosition().z);
 
 	btVector3 Cam2 = Cam1 + (CameraDistance + CameraMargin) * CamDirection;
 
@@ -187,34 +184,176 @@ void Game::Update(float TimeSinceLastFrame)
 		Cam1.y() + (CamCallback._hitfraction * CameraDistance - CameraMargin) * CamDirection.y() / 1.2,
 		Cam1.z() + (CamCallback._hitfraction * CameraDistance - CameraMargin) * CamDirection.z() / 1.2);
 	_Camera->setPosition(CameraPosition);
-	
-	if (_DebugAI)
+}
+
+void Game::Update(float TimeSinceLastFrame)
+{
+	if (!_Headless && _Window->isClosed()) return;
+
+	if (_EscPressed)
+	{
+		AppStateManager::Exit();
+		return;
+	}
+
+	// Ticks of the last frame: from here to Start(), the world and the
+	// characters belong to this thread
+	_Physics->Wait();
+
+	// Everything is done when Run() returns, before the frame is rendered
+	_FrameTime = TimeSinceLastFrame;
+	_Jobs->Run(_Frame);
+
+	return;
+}
+
+// The stages using Ogre's scene, Bullet's world or the input run on the
+// main thread, one after the other as before. The animation of the
+// characters only touches their own animation states and skeleton, it is
+// cut in batches run by any thread, at the same time as the debug drawing
+// and the ticks of the next frame, once the camera has chosen its level of
+// detail.
+void Game::BuildFrame(void)
+{
+	// Characters animated by one job
+	const size_t AnimationBatch = 4;
+
+	_Frame.Clear();
+
+	JobGraph::Job Input = _Frame.Add([this]()
 	{
-		_dd->clear();
+		if (_Headless)
+			UpdateScript(_FrameTime);
+		else
+			UpdateInput();
+
+		if (_JumpPressed)
+		{
+			_Player->Jump();
+			_JumpPressed = false;
+		}
+	}, true);
+
+	JobGraph::Job Publish = _Frame.Add([this]()
+	{
+		const bool Ticked = _Physics->GetTicks() > 0;
+		const float Alpha = _Physics->GetAlpha();
+		_Player->PublishState(Ticked, Alpha);
 		BOOST_FOREACH(auto & cc, _Enemies)
 		{
-			cc->DebugDrawAI(*_dd);
+			cc->PublishState(Ticked, Alpha);
 		}
-		_dd->build();
+	}, true);
+	_Frame.Depend(Publish, Input);
+
+	// The ticks of this frame are simulated while the characters are
+	// animated and the frame is rendered
+	JobGraph::Job Step = _Frame.Add([this]()
+	{
+		_Physics->Start(_FrameTime);
+	}, true);
+	_Frame.Depend(Step, Publish);
+
+	// Last stage before the animation
+	JobGraph::Job Animate = Publish;
+
+	if (!_Headless)
+	{
+		JobGraph::Job Camera = _Frame.Add([this]()
+		{
+			UpdateCamera();
+		}, true);
+		_Frame.Depend(Camera, Publish);
+		_Frame.Depend(Step, Camera);
+
+		// Without a camera (headless), the characters stay fully
+		// animated
+		Animate = _Frame.Add([this]()
+		{
+			_Player->UpdateAnimationLod(*_Camera);
+			BOOST_FOREACH(auto & cc, _Enemies)
+			{
+				cc->UpdateAnimationLod(*_Camera);
+			}
+		}, true);
+		_Frame.Depend(Animate, Camera);
+
+		JobGraph::Job Debug = _Frame.Add([this]()
+		{
+			if (_DebugAI)
+			{
+				_dd->clear();
+				BOOST_FOREACH(auto & cc, _Enemies)
+				{
+					cc->DebugDrawAI(*_dd);
+				}
+				_dd->build();
+			}
+
+			_bulletDebug->draw();
+
+#ifdef PHYSICS_DEBUG
+			_debugDrawer->step();
+#endif
+		}, true);
+		_Frame.Depend(Debug, Publish);
+		_Frame.Depend(Step, Debug);
 	}
-	
-	_bulletDebug->draw();
 
-	return;
+	std::vector<CharacterController *> Characters;
+	Characters.push_back(_Player.get());
+	BOOST_FOREACH(auto & cc, _Enemies)
+	{
+		Characters.push_back(cc.get());
+	}
+
+	for(size_t i = 0; i < Characters.size(); i += AnimationBatch)
+	{
+		std::vector<CharacterController *> Batch(
+			Characters.begin() + i,
+			Characters.begin() + std::min(i + AnimationBatch, Characters.size()));
+
+		JobGraph::Job Animation = _Frame.Add([this, Batch]()
+		{
+			BOOST_FOREACH(auto cc, Batch)
+			{
+				cc->UpdateGraphics(_FrameTime);
+			}
+		});
+		_Frame.Depend(Animation, Animate);
+	}
 }
 
 void Game::BulletCallback(btScalar timeStep)
 {
-	_Player->UpdatePhysics(timeStep);
+	// Contacts of the last tick, looked up by each character
+	_Contacts.Build(*_World->getDispatcher());
+
+	_Player->UpdatePhysics(timeStep, _Contacts);
+
+	Pathfinding::GoalField const & field = _Env->UpdateGoalField(_Player->GetPosition());
+	Pathfinding::Crowd & crowd = _Env->GetCrowd();
+
+	// The enemies are steered together by the crowd, so that they walk
+	// around each other instead of pushing each other
+	//for(auto & cc : _Enemies)
+	BOOST_FOREACH(auto & cc, _Enemies)
+	{
+		if (field.IsValid())
+			crowd.SetTarget(cc->GetCrowdAgent(), field);
+		else
+			crowd.SetTarget(cc->GetCrowdAgent(), _Player->GetPosition());
+		cc->UpdateCrowdState(crowd);
+	}
+
+	_Env->UpdatePathfinding(timeStep);
 
 	//for(auto & cc : _Enemies)
 	BOOST_FOREACH(auto & cc, _Enemies)
 	{
-		cc->UpdateAITarget(_Player->GetPosition(), _Env, 3);
-		cc->UpdateAI(timeStep);
-		//cc->UpdateAI(timeStep, _Player->GetPosition(), _Env, 3);
+		cc->FollowCrowd(crowd);
 
-		cc->UpdatePhysics(timeStep);
+		cc->UpdatePhysics(timeStep, _Contacts);
 	}
 }
 
@@ -227,36 +366,42 @@ void Game::go(void)
 	std::fstream f((level+"/level.txt").c_str(), std::fstream::in);
 	if (f.is_open())
 	{
-		_Env = std::shared_ptr<Environment>(new Environment(_SceneMgr, *_World, f));
+		_Env = std::shared_ptr<Environment>(new Environment(_SceneMgr, *_World, f, level));
 	}
 
 	btVector3 PlayerPosition(0, 10, 0);
 	_Player = std::shared_ptr<CharacterController>(new CharacterController(_SceneMgr, _World, "Sinbad.mesh", 1.8, 100, PlayerPosition, 0, 100));
 
-	_Camera->setOrientation(Ogre::Quaternion(_Pitch, Ogre::Vector3::UNIT_X));
-	_Camera->setPosition(0, CameraHeight - CameraDistance * sin(_Pitch.valueRadians()), CameraDistance * cos(_Pitch.valueRadians()));
+	if (!_Headless)
+	{
+		_Camera->setOrientation(Ogre::Quaternion(_Pitch, Ogre::Vector3::UNIT_X));
+		_Camera->setPosition(0, CameraHeight - CameraDistance * sin(_Pitch.valueRadians()), CameraDistance * cos(_Pitch.valueRadians()));
 
-	_Camera->setNearClipDistance(0.01);
+		_Camera->setNearClipDistance(0.01);
 
-	Ogre::Light* pointLight = _SceneMgr->createLight();
-	pointLight->setType(Ogre::Light::LT_POINT);
-	pointLight->setPosition(Ogre::Vector3(15, 10, 15));
-	pointLight->setDiffuseColour(0.5,0.5,0.5);
-	pointLight->setSpecularColour(0.5,0.5,0.5);
+		Ogre::Light* pointLight = _SceneMgr->createLight();
+		pointLight->setType(Ogre::Light::LT_POINT);
+		pointLight->setPosition(Ogre::Vector3(15, 10, 15));
+		pointLight->setDiffuseColour(0.5,0.5,0.5);
+		pointLight->setSpecularColour(0.5,0.5,0.5);
 
-	Ogre::Light* dirLight = _SceneMgr->createLight();
-	dirLight->setType(Ogre::Light::LT_DIRECTIONAL);
-	dirLight->setDirection(Ogre::Vector3(-1, -1, -1));
-	dirLight->setDiffuseColour(0.5,0.5,0.5);
-	dirLight->setSpecularColour(0.5,0.5,0.5);
+		Ogre::Light* dirLight = _SceneMgr->createLight();
+		dirLight->setType(Ogre::Light::LT_DIRECTIONAL);
+		dirLight->setDirection(Ogre::Vector3(-1, -1, -1));
+		dirLight->setDiffuseColour(0.5,0.5,0.5);
+		dirLight->setSpecularColour(0.5,0.5,0.5);
 
-	_SceneMgr->setAmbientLight(Ogre::ColourValue(0.05, 0.05, 0.05));
+		_SceneMgr->setAmbientLight(Ogre::ColourValue(0.05, 0.05, 0.05));
+	}
 
 	for(float x = 0; x < 8; x += 1)
 	{
 		btVector3 pos(x, 10, -3);
 		_Enemies.push_back(std::shared_ptr<CharacterController>(new CharacterController(_SceneMgr, _World, "Pony.mesh", 1.2, 30, pos, 0, 100)));
+		_Enemies.back()->JoinCrowd(_Env->GetCrowd(), 3);
 	}
 
+	BuildFrame();
+
 	Ogre::LogManager::getSingleton().logMessage("Game started");
 }
@@ -36,6 +36,11 @@
 #include "btOgre/BtOgreExtras.h"
 #include "DebugDrawer.h"
 #include "BulletDebug.h"
+#include "ContactIndex.h"
+#include "ParallelDispatcher.h"
+#include "ParallelSolver.h"
+#include "PhysicsThread.h"
+#include "JobSystem.h"
 
 class Environment;
 class CharacterController;
@@ -57,6 +62,10 @@ public:
 
 private:
 	void go(void);
+	void UpdateInput(void);
+	void UpdateScript(float TimeSinceLastFrame);
+	void UpdateCamera(void);
+	void BuildFrame(void);
 	void setupBullet(void);
 	void cleanupBullet(void);
 
@@ -83,11 +92,26 @@ private:
 	Ogre::Radian                                         _Heading;
 	Ogre::Radian                                         _Pitch;
 
+	// Headless mode: no scene manager, no input, the player is scripted
+	bool                                                 _Headless;
+
+	// Threads running the narrowphase, the solver and the jobs of a frame,
+	// the main one included
+	int                                                  _PhysicsThreads;
+
 	std::shared_ptr<btCollisionConfiguration>          _CollisionConfiguration;
 	std::shared_ptr<btCollisionDispatcher>             _Dispatcher;
 	std::shared_ptr<btBroadphaseInterface>             _OverlappingPairCache;
 	std::shared_ptr<btConstraintSolver>                _Solver;
 	std::shared_ptr<btDynamicsWorld>                   _World;
+	ContactIndex                                       _Contacts;
+	std::unique_ptr<PhysicsThread>                     _Physics;
+
+	// Stages of Update(), built once the characters are created. The
+	// physics thread runs the narrowphase and the solver on _Jobs too.
+	std::unique_ptr<JobSystem>                         _Jobs;
+	JobGraph                                           _Frame;
+	float                                              _FrameTime;
 
 	std::shared_ptr<CharacterController>               _Player;
 	std::vector<std::shared_ptr<CharacterController> > _Enemies;
@@ -97,6 +121,7 @@ private:
 	std::unique_ptr<BulletDebug>                       _bulletDebug;
 
 	bool                                               _EscPressed;
+	bool                                               _JumpPressed;
 	bool                                               _DebugAI;
 	std::unique_ptr<DebugDrawer>                       _dd;
 };
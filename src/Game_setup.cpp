@@ -21,6 +21,9 @@
 #include "AppStateManager.h"
 #include "environment.h"
 
+#include <algorithm>
+#include <thread>
+
 Game::Game(void) :
 	_Root(NULL),
 	_Camera(NULL),
@@ -31,7 +34,11 @@ Game::Game(void) :
 	_Keyboard(NULL),
 	_Heading(0),
 	_Pitch(0),
+	_Headless(false),
+	_PhysicsThreads(std::max(1, (int)std::thread::hardware_concurrency())),
+	_FrameTime(0),
 	_EscPressed(false),
+	_JumpPressed(false),
 	_DebugAI(false)
 {
 }
@@ -46,32 +53,49 @@ void Game::Enter(void)
 	_Window = AppStateManager::GetWindow();
 	_Mouse = AppStateManager::GetMouse();
 	_Keyboard = AppStateManager::GetKeyboard();
-
-	_SceneMgr = _Root->createSceneManager("OctreeSceneManager");
-	_Camera = _SceneMgr->createCamera("PlayerCam");
-	_Viewport = _Window->addViewport(_Camera, 0);
-	_Camera->setAspectRatio(Ogre::Real(_Viewport->getActualWidth()) / Ogre::Real(_Viewport->getActualHeight()));
-
+	_Headless = AppStateManager::IsHeadless();
+
+	// Without a scene manager, only the simulation runs
+	if (!_Headless)
+	{
+		_SceneMgr = _Root->createSceneManager("OctreeSceneManager");
+		_Camera = _SceneMgr->createCamera("PlayerCam");
+		_Viewport = _Window->addViewport(_Camera, 0);
+		_Camera->setAspectRatio(Ogre::Real(_Viewport->getActualWidth()) / Ogre::Real(_Viewport->getActualHeight()));
+	}
+
+	// The narrowphase and the solver run on the threads of the frame
+	_Jobs = std::unique_ptr<JobSystem>(new JobSystem(_PhysicsThreads));
 	setupBullet();
 
-	_dd = std::unique_ptr<DebugDrawer>(new DebugDrawer(_SceneMgr, 0.5));
-	_dd->setEnabled(true);
+	if (!_Headless)
+	{
+		_dd = std::unique_ptr<DebugDrawer>(new DebugDrawer(_SceneMgr, 0.5));
+		_dd->setEnabled(true);
+	}
 	
 	go();
 }
 
 void Game::Exit(void)
 {
+	// The characters are not destroyed while their bodies are stepped
+	_Physics.reset();
+	_Frame.Clear();
 	_dd.reset();
 	
 	_Player = std::shared_ptr<CharacterController>();
 	_Enemies.clear();
 	_Env = std::shared_ptr<Environment>();
 	cleanupBullet();
-
-	AppStateManager::GetWindow()->removeViewport(0);
-	_SceneMgr->destroyCamera(_Camera);
-	AppStateManager::GetOgreRoot()->destroySceneManager(_SceneMgr);
+	_Jobs.reset();
+
+	if (!_Headless)
+	{
+		AppStateManager::GetWindow()->removeViewport(0);
+		_SceneMgr->destroyCamera(_Camera);
+		AppStateManager::GetOgreRoot()->destroySceneManager(_SceneMgr);
+	}
 }
 
 void Game::Pause(void)
@@ -91,9 +115,9 @@ void Game::StaticBulletCallback(btDynamicsWorld *world, btScalar timeStep)
 void Game::setupBullet(void)
 {
 	_CollisionConfiguration = std::shared_ptr<btCollisionConfiguration>(new btDefaultCollisionConfiguration());
-	_Dispatcher = std::shared_ptr<btCollisionDispatcher>(new btCollisionDispatcher(_CollisionConfiguration.get()));
+	_Dispatcher = std::shared_ptr<btCollisionDispatcher>(new ParallelDispatcher(_CollisionConfiguration.get(), *_Jobs));
 	_OverlappingPairCache = std::shared_ptr<btBroadphaseInterface>(new btDbvtBroadphase());
-	_Solver = std::shared_ptr<btConstraintSolver>(new btSequentialImpulseConstraintSolver());
+	_Solver = std::shared_ptr<btConstraintSolver>(new ParallelSolver(*_Jobs));
 
 	_World = std::shared_ptr<btDynamicsWorld>(new btDiscreteDynamicsWorld(
 		_Dispatcher.get(),
@@ -108,11 +132,15 @@ void Game::setupBullet(void)
 		static_cast<void*>(this),
 		true);
 
-	_bulletDebug = std::unique_ptr<BulletDebug>(new BulletDebug(*_SceneMgr, *_World));
+	if (!_Headless)
+		_bulletDebug = std::unique_ptr<BulletDebug>(new BulletDebug(*_SceneMgr, *_World));
+
+	_Physics = std::unique_ptr<PhysicsThread>(new PhysicsThread(*_World, 1. / 60, 3));
 }
 
 void Game::cleanupBullet(void)
 {
+	_Physics.reset();
 	_bulletDebug.reset();
 	
 	_World = std::shared_ptr<btDynamicsWorld>();
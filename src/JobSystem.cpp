@@ -0,0 +1,260 @@
+/*
+    Copyright (C) 2012  Guillaume Meunier <guillaume.meunier@centraliens.net>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, version 3 of the License.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "JobSystem.h"
+
+#include <algorithm>
+
+JobGraph::JobGraph() :
+	_PendingSize(0),
+	_Remaining(0)
+{
+}
+
+JobGraph::~JobGraph()
+{
+}
+
+JobGraph::Job JobGraph::Add(std::function<void()> Function, bool MainThread)
+{
+	Node n;
+	n.Function = Function;
+	n.MainThread = MainThread;
+	n.Dependencies = 0;
+	_Nodes.push_back(n);
+
+	return _Nodes.size() - 1;
+}
+
+void JobGraph::Depend(Job job, Job Before)
+{
+	_Nodes[Before].Next.push_back(job);
+	++_Nodes[job].Dependencies;
+}
+
+void JobGraph::Clear()
+{
+	_Nodes.clear();
+}
+
+JobSystem::JobSystem(int threads) :
+	_Ready(0),
+	_Sleeping(0),
+	_Stopping(false)
+{
+	threads = std::max(threads, 1);
+	for(int i = 0; i < threads; ++i)
+		_Queues.push_back(std::unique_ptr<Queue>(new Queue));
+
+	for(int i = 1; i < threads; ++i)
+		_Threads.push_back(std::thread(&JobSystem::Worker, this, i));
+}
+
+JobSystem::~JobSystem()
+{
+	{
+		std::unique_lock<std::mutex> lock(_Mutex);
+		_Stopping = true;
+	}
+
+	_Wakeup.notify_all();
+
+	for(size_t i = 0; i < _Threads.size(); ++i)
+		_Threads[i].join();
+}
+
+void JobSystem::Run(JobGraph & graph)
+{
+	const int size = graph.Size();
+	if (size == 0)
+		return;
+
+	if (graph._PendingSize != size)
+	{
+		graph._Pending.reset(new std::atomic<int>[size]);
+		graph._PendingSize = size;
+	}
+
+	for(int i = 0; i < size; ++i)
+		graph._Pending[i] = graph._Nodes[i].Dependencies;
+
+	graph._Remaining = size;
+
+	// The first jobs are spread over the threads, the others are pushed
+	// where their last dependency completed
+	int next = 0;
+	for(int i = 0; i < size; ++i)
+	{
+		if (graph._Nodes[i].Dependencies == 0)
+		{
+			Task task = { &graph, i };
+			Push(next++ % _Queues.size(), task);
+		}
+	}
+
+	while (graph._Remaining > 0)
+	{
+		Task task;
+		if (Pop(0, &graph, task))
+		{
+			Execute(0, task);
+			continue;
+		}
+
+		std::unique_lock<std::mutex> lock(_Mutex);
+		++_Sleeping;
+
+		while (graph._Remaining > 0 && _Ready == 0)
+		{
+			{
+				std::unique_lock<std::mutex> queue(graph._MainThreadMutex);
+				if (!graph._MainThreadJobs.empty())
+					break;
+			}
+
+			_Wakeup.wait(lock);
+		}
+
+		--_Sleeping;
+	}
+}
+
+void JobSystem::Worker(int index)
+{
+	while (true)
+	{
+		Task task;
+		if (Pop(index, 0, task))
+		{
+			Execute(index, task);
+			continue;
+		}
+
+		std::unique_lock<std::mutex> lock(_Mutex);
+		++_Sleeping;
+
+		while (_Ready == 0 && !_Stopping)
+			_Wakeup.wait(lock);
+
+		--_Sleeping;
+
+		if (_Stopping)
+			return;
+	}
+}
+
+void JobSystem::Push(int index, Task const & task)
+{
+	JobGraph & graph = *task.Graph;
+
+	if (graph._Nodes[task.Job].MainThread)
+	{
+		{
+			std::unique_lock<std::mutex> queue(graph._MainThreadMutex);
+			graph._MainThreadJobs.push_back(task.Job);
+		}
+
+		// Only the thread running the graph may take it, but it cannot be
+		// told apart from the other threads waiting
+		std::unique_lock<std::mutex> lock(_Mutex);
+		_Wakeup.notify_all();
+		return;
+	}
+
+	{
+		std::unique_lock<std::mutex> queue(_Queues[index]->Mutex);
+		_Queues[index]->Tasks.push_back(task);
+	}
+
+	// A thread going to sleep increments _Sleeping before it checks
+	// _Ready, under _Mutex: either it sees this job, or the job is pushed
+	// after the check and the thread is woken up
+	++_Ready;
+	if (_Sleeping > 0)
+	{
+		std::unique_lock<std::mutex> lock(_Mutex);
+		_Wakeup.notify_one();
+	}
+}
+
+bool JobSystem::Pop(int index, JobGraph * graph, Task & task)
+{
+	// Nobody else can run the jobs for the main thread, they go first
+	if (graph)
+	{
+		std::unique_lock<std::mutex> queue(graph->_MainThreadMutex);
+		if (!graph->_MainThreadJobs.empty())
+		{
+			task.Graph = graph;
+			task.Job = graph->_MainThreadJobs.front();
+			graph->_MainThreadJobs.pop_front();
+			return true;
+		}
+	}
+
+	const int count = _Queues.size();
+	for(int i = 0; i < count; ++i)
+	{
+		Queue & q = *_Queues[(index + i) % count];
+		std::unique_lock<std::mutex> queue(q.Mutex);
+		if (q.Tasks.empty())
+			continue;
+
+		// The last job pushed on its own queue, the first one of another
+		// queue: a thread keeps working on the data it has just touched,
+		// and steals the jobs which have waited the longest
+		if (i == 0)
+		{
+			task = q.Tasks.back();
+			q.Tasks.pop_back();
+		}
+		else
+		{
+			task = q.Tasks.front();
+			q.Tasks.pop_front();
+		}
+
+		--_Ready;
+		return true;
+	}
+
+	return false;
+}
+
+void JobSystem::Execute(int index, Task const & task)
+{
+	JobGraph & graph = *task.Graph;
+	JobGraph::Node const & node = graph._Nodes[task.Job];
+
+	node.Function();
+
+	for(size_t i = 0; i < node.Next.size(); ++i)
+	{
+		if (--graph._Pending[node.Next[i]] == 0)
+		{
+			Task next = { &graph, node.Next[i] };
+			Push(index, next);
+		}
+	}
+
+	// The thread running the graph may return and destroy it as soon as
+	// _Remaining is null
+	if (--graph._Remaining == 0)
+	{
+		std::unique_lock<std::mutex> lock(_Mutex);
+		_Wakeup.notify_all();
+	}
+}
@@ -0,0 +1,142 @@
+/*
+    Copyright (C) 2012  Guillaume Meunier <guillaume.meunier@centraliens.net>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, version 3 of the License.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef JOBSYSTEM_H
+#define JOBSYSTEM_H
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Jobs and the order in which they must run. A graph is built once and may
+// be run any number of times, by one thread at a time.
+class JobGraph
+{
+public:
+	typedef int Job;
+
+	JobGraph();
+	~JobGraph();
+
+	// Jobs for the main thread are only run by the thread calling
+	// JobSystem::Run(), for the APIs which are not thread safe (Ogre,
+	// Bullet's world...). The others run on any thread.
+	Job Add(std::function<void()> Function, bool MainThread = false);
+
+	// Job does not start before Before has completed
+	void Depend(Job job, Job Before);
+
+	int Size() const
+	{
+		return _Nodes.size();
+	}
+
+	void Clear();
+
+private:
+	friend class JobSystem;
+
+	struct Node
+	{
+		std::function<void()> Function;
+		bool MainThread;
+		std::vector<Job> Next;
+		int Dependencies;
+	};
+
+	std::vector<Node> _Nodes;
+
+	// Dependencies left to each job while the graph runs
+	std::unique_ptr<std::atomic<int>[]> _Pending;
+	int _PendingSize;
+	// Jobs not completed yet
+	std::atomic<int> _Remaining;
+
+	// Ready jobs for the thread running the graph
+	std::mutex _MainThreadMutex;
+	std::deque<Job> _MainThreadJobs;
+
+	JobGraph(JobGraph const &);
+	JobGraph & operator=(JobGraph const &);
+};
+
+// Pool of threads running job graphs. Each thread has its own queue, where
+// the jobs it makes ready are pushed and popped in LIFO order; a thread
+// with an empty queue steals the oldest job of another one. The calling
+// thread runs jobs too until the graph is done, and alone runs the jobs for
+// the main thread.
+//
+// Several threads may run graphs at the same time, the rendering and the
+// physics threads of the game: they share the workers, and each of them
+// may run the jobs of the others while it waits for its own graph. The
+// thread which built the system has the first queue, the other ones push
+// their jobs there too.
+class JobSystem
+{
+public:
+	// Threads running the jobs, the calling one included
+	JobSystem(int threads);
+	~JobSystem();
+
+	int GetThreads() const
+	{
+		return _Queues.size();
+	}
+
+	// Blocks until every job of the graph has completed. A job may not run
+	// another graph.
+	void Run(JobGraph & graph);
+
+private:
+	struct Task
+	{
+		JobGraph * Graph;
+		JobGraph::Job Job;
+	};
+
+	struct Queue
+	{
+		std::mutex Mutex;
+		std::deque<Task> Tasks;
+	};
+
+	// The first queue is the calling thread's
+	std::vector<std::unique_ptr<Queue> > _Queues;
+	std::vector<std::thread> _Threads;
+
+	// Jobs in the queues, the ones for the main thread excepted
+	std::atomic<int> _Ready;
+	std::atomic<int> _Sleeping;
+	bool _Stopping;
+
+	std::mutex _Mutex;
+	std::condition_variable _Wakeup;
+
+	JobSystem(JobSystem const &);
+	JobSystem & operator=(JobSystem const &);
+
+	void Worker(int index);
+	void Push(int index, Task const & task);
+	bool Pop(int index, JobGraph * graph, Task & task);
+	void Execute(int index, Task const & task);
+};
+
+#endif // JOBSYSTEM_H
@@ -15,21 +15,18 @@
     along with this program.  If not, see <http://www.gnu.org/licenses/>.
 */
 
+#include <algorithm>
 #include <vector>
 
 #include <boost/date_time.hpp>
 
 #include <OgreVector3.h>
 #include <OgreVertexIndexData.h>
-#include <OgreEntity.h>
-#include <OgreSubEntity.h>
+#include <OgreMesh.h>
 #include <OgreSubMesh.h>
 #include <boost/foreach.hpp>
 
-#include "bullet/BulletCollision/CollisionShapes/btTriangleMesh.h"
-
 #include "OgreConverter.h"
-#include "Pathfinding/Pathfinding.h"
 
 void OgreConverter::AddVertices(Ogre::VertexData * data)
 {
@@ -84,17 +81,17 @@ void OgreConverter::AddIndexData(Ogre::IndexData * data, int offset)
 	}
 }
 
-OgreConverter::OgreConverter(Ogre::Entity& entity)
+OgreConverter::OgreConverter(Ogre::Mesh& mesh)
 {
 	boost::posix_time::ptime start = boost::posix_time::microsec_clock::universal_time();
-	if (entity.getMesh()->sharedVertexData)
+	if (mesh.sharedVertexData)
 	{
-		AddVertices(entity.getMesh()->sharedVertexData);
+		AddVertices(mesh.sharedVertexData);
 	}
 
-	for(unsigned int i = 0; i < entity.getNumSubEntities(); i++)
+	for(unsigned int i = 0; i < mesh.getNumSubMeshes(); i++)
 	{
-		Ogre::SubMesh * submesh = entity.getSubEntity(i)->getSubMesh();
+		Ogre::SubMesh * submesh = mesh.getSubMesh(i);
 		if (submesh->useSharedVertices)
 		{
 			AddIndexData(submesh->indexData, 0);
@@ -105,50 +102,70 @@ OgreConverter::OgreConverter(Ogre::Entity& entity)
 			AddVertices(submesh->vertexData);
 		}
 	}
+	WeldVertices();
 	boost::posix_time::time_duration t = boost::posix_time::microsec_clock::universal_time() - start;
 	
 	std::cout << "Read triangles: " << t << "\n";
 }
 
-static btVector3 Ogre2Bullet(Ogre::Vector3 const& v)
+// Ogre splits the vertices by normal and texture coordinates, only their
+// position is kept here so most of them are duplicates
+void OgreConverter::WeldVertices()
 {
-	return btVector3(v.x, v.y, v.z);
-}
-
-void OgreConverter::AddToTriMesh(Ogre::Matrix4 const& transform, btTriangleMesh& trimesh) const
-{
-	boost::posix_time::ptime start = boost::posix_time::microsec_clock::universal_time();
+	auto less = [this](uint32_t a, uint32_t b)
+	{
+		Ogre::Vector3 const & va = Vertices[a];
+		Ogre::Vector3 const & vb = Vertices[b];
+		if (va.x != vb.x) return va.x < vb.x;
+		if (va.y != vb.y) return va.y < vb.y;
+		return va.z < vb.z;
+	};
+
+	std::vector<uint32_t> order(Vertices.size());
+	for(size_t i = 0; i < order.size(); ++i)
+		order[i] = i;
+	std::sort(order.begin(), order.end(), less);
+
+	std::vector<Ogre::Vector3> welded;
+	std::vector<uint32_t> remap(Vertices.size());
+	for(size_t i = 0; i < order.size(); ++i)
+	{
+		if (i == 0 || less(order[i - 1], order[i]))
+			welded.push_back(Vertices[order[i]]);
+		remap[order[i]] = welded.size() - 1;
+	}
 
-	//for(auto const i : Faces)
-	BOOST_FOREACH(auto const i, Faces)
+	BOOST_FOREACH(Face & f, Faces)
 	{
-		Ogre::Vector3 v1 = transform * Vertices[i.VertexIndices[0]];
-		Ogre::Vector3 v2 = transform * Vertices[i.VertexIndices[1]];
-		Ogre::Vector3 v3 = transform * Vertices[i.VertexIndices[2]];
-
-		trimesh.addTriangle(
-			Ogre2Bullet(v1),
-			Ogre2Bullet(v2),
-			Ogre2Bullet(v3));
+		f.VertexIndices[0] = remap[f.VertexIndices[0]];
+		f.VertexIndices[1] = remap[f.VertexIndices[1]];
+		f.VertexIndices[2] = remap[f.VertexIndices[2]];
 	}
-	boost::posix_time::time_duration t = boost::posix_time::microsec_clock::universal_time() - start;
-	
-	std::cout << "Convert to bullet: " << t << "\n";
+
+	Vertices.swap(welded);
 }
 
-void OgreConverter::AddToHeightField(Ogre::Matrix4 const& transform, Pathfinding::NavMesh & navmesh) const
+void OgreConverter::AddToMesh(Ogre::Matrix4 const& transform, std::vector<Ogre::Vector3>& vertices, std::vector<int>& indices) const
 {
 	boost::posix_time::ptime start = boost::posix_time::microsec_clock::universal_time();
-	
-	//for(auto const i : Faces)
-	BOOST_FOREACH(auto const i, Faces)
+
+	// The blocks are only rotated and moved: no projection, so no division
+	// by w
+	assert(transform.isAffine());
+
+	const int first = vertices.size();
+	vertices.resize(first + Vertices.size());
+	for(size_t i = 0; i < Vertices.size(); ++i)
+		vertices[first + i] = transform.transformAffine(Vertices[i]);
+
+	indices.reserve(indices.size() + Faces.size() * 3);
+	BOOST_FOREACH(auto const & i, Faces)
 	{
-		navmesh.AddTriangle(transform * Vertices[i.VertexIndices[0]],
-		                    transform * Vertices[i.VertexIndices[1]],
-		                    transform * Vertices[i.VertexIndices[2]], 1);
+		indices.push_back(first + i.VertexIndices[0]);
+		indices.push_back(first + i.VertexIndices[1]);
+		indices.push_back(first + i.VertexIndices[2]);
 	}
 	boost::posix_time::time_duration t = boost::posix_time::microsec_clock::universal_time() - start;
-	
-	std::cout << "Rasterization: " << t << "\n";
-}
 
+	std::cout << "Transform vertices: " << t << "\n";
+}
@@ -33,17 +33,10 @@ namespace Ogre
 {
 	class VertexData;
 	class IndexData;
-	class Entity;
+	class Mesh;
 	class Matrix4;
 }
 
-class btTriangleMesh;
-
-namespace Pathfinding
-{
-class NavMesh;
-}
-
 class OgreConverter
 {
 	struct Face
@@ -56,11 +49,15 @@ class OgreConverter
 
 	void AddVertices(Ogre::VertexData * data);
 	void AddIndexData(Ogre::IndexData * data, int offset);
+	void WeldVertices();
 
 public:
-	OgreConverter(Ogre::Entity& entity);
-	void AddToTriMesh(Ogre::Matrix4 const& transform, btTriangleMesh& trimesh) const;
-	void AddToHeightField(Ogre::Matrix4 const& transform, Pathfinding::NavMesh& navmesh) const;
+	OgreConverter(Ogre::Mesh& mesh);
+
+	// Appends the transformed vertices and the faces of the mesh to an
+	// indexed mesh, each vertex is transformed once. Vertices with the
+	// same position are merged.
+	void AddToMesh(Ogre::Matrix4 const& transform, std::vector<Ogre::Vector3>& vertices, std::vector<int>& indices) const;
 };
 
 #endif
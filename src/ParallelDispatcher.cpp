@@ -0,0 +1,491 @@
+/*
+    Copyright (C) 2012  Guillaume Meunier <guillaume.meunier@centraliens.net>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, version 3 of the License.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "ParallelDispatcher.h"
+
+#include "bullet/BulletCollision/BroadphaseCollision/btOverlappingPairCache.h"
+#include "bullet/BulletCollision/CollisionDispatch/btCollisionConfiguration.h"
+#include "bullet/BulletCollision/CollisionDispatch/btCollisionObject.h"
+#include "bullet/BulletCollision/CollisionDispatch/btConvexConvexAlgorithm.h"
+#include "bullet/BulletCollision/CollisionDispatch/btConvexConcaveCollisionAlgorithm.h"
+#include "bullet/BulletCollision/CollisionShapes/btCollisionShape.h"
+#include "bullet/BulletCollision/NarrowPhaseCollision/btPersistentManifold.h"
+#include "bullet/LinearMath/btPoolAllocator.h"
+
+#include <boost/foreach.hpp>
+#include <boost/thread/tss.hpp>
+
+#include <algorithm>
+
+extern int gNumManifold;
+
+// Same defaults as btDefaultCollisionConstructionInfo
+static const int poolsize = 4096;
+
+static int roundSize(int size)
+{
+	return (size + 15) & ~15;
+}
+
+namespace
+{
+// btConvexConvexAlgorithm with its own simplex solver. The base class only
+// keeps the address of the solver, which is built after it.
+class ConvexConvexAlgorithm : public btConvexConvexAlgorithm
+{
+	btVoronoiSimplexSolver _SimplexSolver;
+
+public:
+	ConvexConvexAlgorithm(const btCollisionAlgorithmConstructionInfo & ci, btCollisionObject * body0, btCollisionObject * body1, btConvexConvexAlgorithm::CreateFunc const & settings) :
+		btConvexConvexAlgorithm(ci.m_manifold, ci, body0, body1, &_SimplexSolver, settings.m_pdSolver, settings.m_numPerturbationIterations, settings.m_minimumPointsPerturbationThreshold)
+	{
+	}
+
+	// Takes its settings from the create function of the configuration
+	struct CreateFunc : public btCollisionAlgorithmCreateFunc
+	{
+		btConvexConvexAlgorithm::CreateFunc const & settings;
+
+		CreateFunc(btConvexConvexAlgorithm::CreateFunc const & _settings) : settings(_settings)
+		{
+		}
+
+		virtual btCollisionAlgorithm * CreateCollisionAlgorithm(btCollisionAlgorithmConstructionInfo & ci, btCollisionObject * body0, btCollisionObject * body1)
+		{
+			void * mem = ci.m_dispatcher1->allocateCollisionAlgorithm(sizeof(ConvexConvexAlgorithm));
+			return new(mem) ConvexConvexAlgorithm(ci, body0, body1, settings);
+		}
+	};
+};
+
+// Result of the near callback, with the copy of the concave body in place
+// of the body. The order of the bodies may differ from the algorithm's.
+class CopyResult : public btManifoldResult
+{
+public:
+	CopyResult(btManifoldResult const & result, btCollisionObject * original, btCollisionObject * copy) : btManifoldResult(result)
+	{
+		if (m_body0 == original)
+			m_body0 = copy;
+		else if (m_body1 == original)
+			m_body1 = copy;
+	}
+};
+
+// btConvexConcaveCollisionAlgorithm colliding a copy of the concave body,
+// updated before each collision: the triangles are set as the shape of the
+// copy, which is also the body seen by the contact callbacks. The manifold
+// gets the real bodies back for the solver.
+class ConvexConcaveAlgorithm : public btConvexConcaveCollisionAlgorithm
+{
+	std::unique_ptr<btCollisionObject> _Copy;
+	btPersistentManifold * _Manifold;
+	bool _Swapped;
+
+public:
+	ConvexConcaveAlgorithm(const btCollisionAlgorithmConstructionInfo & ci, btCollisionObject * body0, btCollisionObject * body1, bool swapped, btCollisionObject * copy) :
+		btConvexConcaveCollisionAlgorithm(ci, swapped ? copy : body0, swapped ? body1 : copy, swapped),
+		_Copy(copy),
+		_Manifold(0),
+		_Swapped(swapped)
+	{
+		btManifoldArray manifolds;
+		getAllContactManifolds(manifolds);
+		_Manifold = manifolds[0];
+		_Manifold->setBodies(swapped ? body1 : body0, swapped ? body0 : body1);
+	}
+
+	virtual void processCollision(btCollisionObject * body0, btCollisionObject * body1, const btDispatcherInfo & dispatchInfo, btManifoldResult * resultOut)
+	{
+		btCollisionObject * & concave = _Swapped ? body0 : body1;
+		btCollisionObject * convex = _Swapped ? body1 : body0;
+		btCollisionObject * original = concave;
+
+		*_Copy = *original;
+		concave = _Copy.get();
+
+		CopyResult result(*resultOut, original, concave);
+		btConvexConcaveCollisionAlgorithm::processCollision(body0, body1, dispatchInfo, &result);
+
+		_Manifold->setBodies(convex, original);
+	}
+
+	struct CreateFunc : public btCollisionAlgorithmCreateFunc
+	{
+		bool swapped;
+
+		CreateFunc(bool _swapped) : swapped(_swapped)
+		{
+		}
+
+		virtual btCollisionAlgorithm * CreateCollisionAlgorithm(btCollisionAlgorithmConstructionInfo & ci, btCollisionObject * body0, btCollisionObject * body1)
+		{
+			btCollisionObject * copy = new btCollisionObject(swapped ? *body0 : *body1);
+			void * mem = ci.m_dispatcher1->allocateCollisionAlgorithm(sizeof(ConvexConcaveAlgorithm));
+			return new(mem) ConvexConcaveAlgorithm(ci, body0, body1, swapped, copy);
+		}
+	};
+};
+}
+
+// Pools and results of a range of pairs, bound to the thread processing it
+struct ParallelDispatcher::Context
+{
+	ParallelDispatcher & Owner;
+	btPoolAllocator Algorithms;
+	btPoolAllocator Manifolds;
+
+	// Pair being processed, and pairs left to the calling thread
+	int Pair;
+	std::vector<int> Serial;
+
+	std::vector<ManifoldChange> Changes;
+
+	Context(ParallelDispatcher & owner, int algorithmsize) :
+		Owner(owner),
+		Algorithms(algorithmsize, poolsize),
+		Manifolds(roundSize(sizeof(btPersistentManifold)), poolsize),
+		Pair(-1)
+	{
+	}
+};
+
+// The contexts belong to the dispatcher, not to the threads
+static void nocleanup(ParallelDispatcher::Context *)
+{
+}
+
+static boost::thread_specific_ptr<ParallelDispatcher::Context> current(nocleanup);
+
+namespace
+{
+class Bind
+{
+	Bind(Bind const &);
+	Bind & operator=(Bind const &);
+
+public:
+	Bind(ParallelDispatcher::Context & context)
+	{
+		current.reset(&context);
+	}
+
+	~Bind()
+	{
+		current.reset();
+	}
+};
+}
+
+static ParallelDispatcher::Context * getContext(ParallelDispatcher const & dispatcher)
+{
+	ParallelDispatcher::Context * context = current.get();
+	return context && &context->Owner == &dispatcher ? context : 0;
+}
+
+ParallelDispatcher::ParallelDispatcher(btCollisionConfiguration * configuration, JobSystem & jobs) :
+	btCollisionDispatcher(configuration),
+	_Jobs(jobs),
+	_Pairs(0),
+	_Count(0),
+	_DispatchInfo(0)
+{
+	// Replace the algorithms of the configuration, the others are left
+	// to the calling thread
+	btConvexConvexAlgorithm::CreateFunc * convexconvex = dynamic_cast<btConvexConvexAlgorithm::CreateFunc *>(
+		configuration->getCollisionAlgorithmCreateFunc(CONVEX_HULL_SHAPE_PROXYTYPE, CONVEX_HULL_SHAPE_PROXYTYPE));
+	btConvexConcaveCollisionAlgorithm::CreateFunc * convexconcave = dynamic_cast<btConvexConcaveCollisionAlgorithm::CreateFunc *>(
+		configuration->getCollisionAlgorithmCreateFunc(CONVEX_HULL_SHAPE_PROXYTYPE, TRIANGLE_MESH_SHAPE_PROXYTYPE));
+	btConvexConcaveCollisionAlgorithm::SwappedCreateFunc * swapped = dynamic_cast<btConvexConcaveCollisionAlgorithm::SwappedCreateFunc *>(
+		configuration->getCollisionAlgorithmCreateFunc(TRIANGLE_MESH_SHAPE_PROXYTYPE, CONVEX_HULL_SHAPE_PROXYTYPE));
+
+	if (convexconvex)
+		_ConvexConvex.reset(new ConvexConvexAlgorithm::CreateFunc(*convexconvex));
+	if (convexconcave)
+		_ConvexConcave.reset(new ConvexConcaveAlgorithm::CreateFunc(false));
+	if (swapped)
+		_SwappedConvexConcave.reset(new ConvexConcaveAlgorithm::CreateFunc(true));
+
+	for(int i = 0; i < MAX_BROADPHASE_COLLISION_TYPES; ++i)
+	{
+		for(int j = 0; j < MAX_BROADPHASE_COLLISION_TYPES; ++j)
+		{
+			btCollisionAlgorithmCreateFunc * createfunc = m_doubleDispatch[i][j];
+
+			if (convexconvex && createfunc == convexconvex)
+				registerCollisionCreateFunc(i, j, _ConvexConvex.get());
+			else if (convexconcave && createfunc == convexconcave)
+				registerCollisionCreateFunc(i, j, _ConvexConcave.get());
+			else if (swapped && createfunc == swapped)
+				registerCollisionCreateFunc(i, j, _SwappedConvexConcave.get());
+		}
+	}
+
+	// The algorithms without state of the configuration are kept
+	_ThreadSafe.push_back(_ConvexConvex.get());
+	_ThreadSafe.push_back(_ConvexConcave.get());
+	_ThreadSafe.push_back(_SwappedConvexConcave.get());
+	_ThreadSafe.push_back(configuration->getCollisionAlgorithmCreateFunc(SPHERE_SHAPE_PROXYTYPE, SPHERE_SHAPE_PROXYTYPE));
+	_ThreadSafe.push_back(configuration->getCollisionAlgorithmCreateFunc(SPHERE_SHAPE_PROXYTYPE, TRIANGLE_SHAPE_PROXYTYPE));
+	_ThreadSafe.push_back(configuration->getCollisionAlgorithmCreateFunc(TRIANGLE_SHAPE_PROXYTYPE, SPHERE_SHAPE_PROXYTYPE));
+	_ThreadSafe.push_back(configuration->getCollisionAlgorithmCreateFunc(BOX_SHAPE_PROXYTYPE, BOX_SHAPE_PROXYTYPE));
+	_ThreadSafe.erase(std::remove(_ThreadSafe.begin(), _ThreadSafe.end(), (btCollisionAlgorithmCreateFunc *)0), _ThreadSafe.end());
+
+	const int algorithmsize = roundSize(std::max<int>(
+		m_collisionAlgorithmPoolAllocator->getElementSize(),
+		std::max(sizeof(ConvexConvexAlgorithm), sizeof(ConvexConcaveAlgorithm))));
+
+	const int threads = jobs.GetThreads();
+	for(int i = 0; i < threads; ++i)
+	{
+		_Contexts.push_back(std::unique_ptr<Context>(new Context(*this, algorithmsize)));
+
+		Context * context = _Contexts.back().get();
+		_Ranges.Add([this, context, i, threads]()
+		{
+			const int first = (long long)_Count * i / threads;
+			const int last = (long long)_Count * (i + 1) / threads;
+			dispatchRange(*context, _Pairs, first, last, *_DispatchInfo);
+		});
+	}
+}
+
+ParallelDispatcher::~ParallelDispatcher()
+{
+}
+
+bool ParallelDispatcher::isParallel(btBroadphasePair const & pair) const
+{
+	const int type0 = static_cast<btCollisionObject *>(pair.m_pProxy0->m_clientObject)->getCollisionShape()->getShapeType();
+	const int type1 = static_cast<btCollisionObject *>(pair.m_pProxy1->m_clientObject)->getCollisionShape()->getShapeType();
+
+	return std::find(_ThreadSafe.begin(), _ThreadSafe.end(), m_doubleDispatch[type0][type1]) != _ThreadSafe.end();
+}
+
+void ParallelDispatcher::dispatchRange(Context & context, btBroadphasePair * pairs, int first, int last, const btDispatcherInfo & dispatchInfo)
+{
+	Bind bind(context);
+	btNearCallback callback = getNearCallback();
+
+	context.Serial.clear();
+
+	for(int i = first; i < last; ++i)
+	{
+		if (!isParallel(pairs[i]))
+		{
+			context.Serial.push_back(i);
+			continue;
+		}
+
+		context.Pair = i;
+		callback(pairs[i], *this, dispatchInfo);
+	}
+}
+
+void ParallelDispatcher::dispatchAllCollisionPairs(btOverlappingPairCache * pairCache, const btDispatcherInfo & dispatchInfo, btDispatcher * dispatcher)
+{
+	// The time of impact of continuous collision detection is shared by
+	// all the pairs
+	if (dispatchInfo.m_dispatchFunc != btDispatcherInfo::DISPATCH_DISCRETE)
+	{
+		btCollisionDispatcher::dispatchAllCollisionPairs(pairCache, dispatchInfo, dispatcher);
+		return;
+	}
+
+	const int count = pairCache->getNumOverlappingPairs();
+	if (!count)
+		return;
+
+	btBroadphasePair * pairs = pairCache->getOverlappingPairArrayPtr();
+	const int ranges = _Contexts.size();
+
+	if (ranges > 1)
+	{
+		_Pairs = pairs;
+		_Count = count;
+		_DispatchInfo = &dispatchInfo;
+		_Jobs.Run(_Ranges);
+	}
+	else
+	{
+		dispatchRange(*_Contexts[0], pairs, 0, count, dispatchInfo);
+	}
+
+	// Pairs with other algorithms, in order
+	{
+		Context & context = *_Contexts[0];
+		Bind bind(context);
+		btNearCallback callback = getNearCallback();
+
+		for(int i = 0; i < ranges; ++i)
+		{
+			BOOST_FOREACH(int pair, _Contexts[i]->Serial)
+			{
+				context.Pair = pair;
+				callback(pairs[pair], *this, dispatchInfo);
+			}
+		}
+	}
+
+	applyChanges();
+}
+
+// Adds and removes the manifolds as btCollisionDispatcher would have, in
+// the order of their pairs. A pair is processed by a single range, which
+// keeps the order of its changes.
+void ParallelDispatcher::applyChanges()
+{
+	_Changes.clear();
+
+	BOOST_FOREACH(auto const & context, _Contexts)
+	{
+		_Changes.insert(_Changes.end(), context->Changes.begin(), context->Changes.end());
+		context->Changes.clear();
+	}
+
+	std::stable_sort(_Changes.begin(), _Changes.end(), [](ManifoldChange const & a, ManifoldChange const & b)
+	{
+		return a.Pair < b.Pair;
+	});
+
+	BOOST_FOREACH(ManifoldChange const & change, _Changes)
+	{
+		if (change.Created)
+		{
+			gNumManifold++;
+			change.Manifold->m_index1a = m_manifoldsPtr.size();
+			m_manifoldsPtr.push_back(change.Manifold);
+		}
+		else
+		{
+			releaseManifold(change.Manifold);
+		}
+	}
+}
+
+btPersistentManifold * ParallelDispatcher::getNewManifold(void * b0, void * b1)
+{
+	Context * context = getContext(*this);
+	if (!context)
+		return btCollisionDispatcher::getNewManifold(b0, b1);
+
+	btCollisionObject * body0 = static_cast<btCollisionObject *>(b0);
+	btCollisionObject * body1 = static_cast<btCollisionObject *>(b1);
+
+	// Same thresholds as btCollisionDispatcher
+	btScalar contactBreakingThreshold = (m_dispatcherFlags & btCollisionDispatcher::CD_USE_RELATIVE_CONTACT_BREAKING_THRESHOLD) ?
+		btMin(body0->getCollisionShape()->getContactBreakingThreshold(gContactBreakingThreshold), body1->getCollisionShape()->getContactBreakingThreshold(gContactBreakingThreshold)) :
+		gContactBreakingThreshold;
+
+	btScalar contactProcessingThreshold = btMin(body0->getContactProcessingThreshold(), body1->getContactProcessingThreshold());
+
+	void * mem;
+	if (context->Manifolds.getFreeCount())
+		mem = context->Manifolds.allocate(sizeof(btPersistentManifold));
+	else
+		mem = btAlignedAlloc(sizeof(btPersistentManifold), 16);
+
+	btPersistentManifold * manifold = new(mem) btPersistentManifold(body0, body1, 0, contactBreakingThreshold, contactProcessingThreshold);
+	context->Changes.push_back(ManifoldChange(context->Pair, manifold, true));
+
+	return manifold;
+}
+
+void ParallelDispatcher::releaseManifold(btPersistentManifold * manifold)
+{
+	Context * context = getContext(*this);
+	if (context)
+	{
+		context->Changes.push_back(ManifoldChange(context->Pair, manifold, false));
+		return;
+	}
+
+	// As btCollisionDispatcher, which only knows its own pool
+	gNumManifold--;
+	clearManifold(manifold);
+
+	int index = manifold->m_index1a;
+	btAssert(index < m_manifoldsPtr.size());
+	m_manifoldsPtr.swap(index, m_manifoldsPtr.size() - 1);
+	m_manifoldsPtr[index]->m_index1a = index;
+	m_manifoldsPtr.pop_back();
+
+	manifold->~btPersistentManifold();
+	freeManifold(manifold);
+}
+
+void ParallelDispatcher::freeManifold(btPersistentManifold * manifold)
+{
+	if (m_persistentManifoldPoolAllocator->validPtr(manifold))
+	{
+		m_persistentManifoldPoolAllocator->freeMemory(manifold);
+		return;
+	}
+
+	BOOST_FOREACH(auto const & context, _Contexts)
+	{
+		if (context->Manifolds.validPtr(manifold))
+		{
+			context->Manifolds.freeMemory(manifold);
+			return;
+		}
+	}
+
+	btAlignedFree(manifold);
+}
+
+void * ParallelDispatcher::allocateCollisionAlgorithm(int size)
+{
+	Context * context = getContext(*this);
+	btPoolAllocator & pool = context ? context->Algorithms : *m_collisionAlgorithmPoolAllocator;
+
+	// The algorithms replaced by the dispatcher may not fit in the pool
+	// of the configuration
+	if (size <= pool.getElementSize() && pool.getFreeCount())
+		return pool.allocate(size);
+
+	return btAlignedAlloc(size, 16);
+}
+
+void ParallelDispatcher::freeCollisionAlgorithm(void * ptr)
+{
+	// Algorithms are freed by the range which allocated them, for each
+	// triangle of a concave shape, or out of the ranges when their pair
+	// is removed
+	Context * context = getContext(*this);
+	if (context && context->Algorithms.validPtr(ptr))
+	{
+		context->Algorithms.freeMemory(ptr);
+		return;
+	}
+
+	if (m_collisionAlgorithmPoolAllocator->validPtr(ptr))
+	{
+		m_collisionAlgorithmPoolAllocator->freeMemory(ptr);
+		return;
+	}
+
+	BOOST_FOREACH(auto const & other, _Contexts)
+	{
+		if (other->Algorithms.validPtr(ptr))
+		{
+			other->Algorithms.freeMemory(ptr);
+			return;
+		}
+	}
+
+	btAlignedFree(ptr);
+}
@@ -0,0 +1,105 @@
+/*
+    Copyright (C) 2012  Guillaume Meunier <guillaume.meunier@centraliens.net>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, version 3 of the License.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef PARALLELDISPATCHER_H
+#define PARALLELDISPATCHER_H
+
+#include "bullet/BulletCollision/CollisionDispatch/btCollisionDispatcher.h"
+#include "JobSystem.h"
+
+#include <memory>
+#include <vector>
+
+// Collision dispatcher running the narrowphase of the overlapping pairs on
+// the threads of a job system. The pair array is cut in one contiguous
+// range per thread, run as a job: each range allocates its algorithms and manifolds from its own
+// pools, and the manifolds created by the ranges are added to the
+// dispatcher once they are all done, in pair order: the solver gets the
+// same manifolds in the same order as with btCollisionDispatcher, whatever
+// the number of threads.
+//
+// Two algorithms of Bullet are not thread safe and are replaced: the
+// convex-convex one uses the simplex solver of the configuration, shared
+// by all pairs, and the convex-concave one sets each triangle as the shape
+// of the concave body while it collides it. The replacements have their
+// own simplex solver and their own copy of the concave body. Pairs using
+// other algorithms (compounds, planes...) and continuous collision
+// detection are run on the calling thread.
+class ParallelDispatcher : public btCollisionDispatcher
+{
+public:
+	struct Context;
+
+	ParallelDispatcher(btCollisionConfiguration * configuration, JobSystem & jobs);
+	virtual ~ParallelDispatcher();
+
+	int GetThreads() const
+	{
+		return _Contexts.size();
+	}
+
+	virtual btPersistentManifold * getNewManifold(void * body0, void * body1);
+	virtual void releaseManifold(btPersistentManifold * manifold);
+
+	virtual void dispatchAllCollisionPairs(btOverlappingPairCache * pairCache, const btDispatcherInfo & dispatchInfo, btDispatcher * dispatcher);
+
+	virtual void * allocateCollisionAlgorithm(int size);
+	virtual void freeCollisionAlgorithm(void * ptr);
+
+private:
+	std::vector<std::unique_ptr<Context> > _Contexts;
+
+	// One job per context, on the pairs of the current dispatch
+	JobSystem & _Jobs;
+	JobGraph _Ranges;
+	btBroadphasePair * _Pairs;
+	int _Count;
+	btDispatcherInfo const * _DispatchInfo;
+
+	std::unique_ptr<btCollisionAlgorithmCreateFunc> _ConvexConvex;
+	std::unique_ptr<btCollisionAlgorithmCreateFunc> _ConvexConcave;
+	std::unique_ptr<btCollisionAlgorithmCreateFunc> _SwappedConvexConcave;
+
+	// Create functions of the pairs run by the ranges
+	std::vector<btCollisionAlgorithmCreateFunc *> _ThreadSafe;
+
+	// Manifold created or released by a range while it processed a pair
+	struct ManifoldChange
+	{
+		int Pair;
+		btPersistentManifold * Manifold;
+		bool Created;
+
+		ManifoldChange(int pair, btPersistentManifold * manifold, bool created) :
+			Pair(pair),
+			Manifold(manifold),
+			Created(created)
+		{
+		}
+	};
+
+	std::vector<ManifoldChange> _Changes;
+
+	ParallelDispatcher(ParallelDispatcher const &);
+	ParallelDispatcher & operator=(ParallelDispatcher const &);
+
+	bool isParallel(btBroadphasePair const & pair) const;
+	void dispatchRange(Context & context, btBroadphasePair * pairs, int first, int last, const btDispatcherInfo & dispatchInfo);
+	void applyChanges();
+	void freeManifold(btPersistentManifold * manifold);
+};
+
+#endif // PARALLELDISPATCHER_H
@@ -0,0 +1,132 @@
+/*
+    Copyright (C) 2012  Guillaume Meunier <guillaume.meunier@centraliens.net>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, version 3 of the License.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "ParallelSolver.h"
+
+#include "bullet/BulletDynamics/ConstraintSolver/btContactSolverInfo.h"
+
+#include <boost/foreach.hpp>
+
+#include <algorithm>
+
+ParallelSolver::ParallelSolver(JobSystem & jobs) :
+	_Jobs(jobs),
+	_Info(0),
+	_DebugDrawer(0),
+	_StackAlloc(0),
+	_Dispatcher(0)
+{
+	const int threads = jobs.GetThreads();
+	for(int i = 0; i < threads; ++i)
+	{
+		_Solvers.push_back(std::unique_ptr<btSequentialImpulseConstraintSolver>(new btSequentialImpulseConstraintSolver));
+
+		btSequentialImpulseConstraintSolver * solver = _Solvers.back().get();
+		_Ranges.Add([this, solver, i]()
+		{
+			solveRange(*solver, _Bounds[i], _Bounds[i + 1], *_Info, _DebugDrawer, _StackAlloc);
+		});
+	}
+}
+
+ParallelSolver::~ParallelSolver()
+{
+}
+
+btScalar ParallelSolver::solveGroup(btCollisionObject ** bodies, int numBodies, btPersistentManifold ** manifolds, int numManifolds, btTypedConstraint ** constraints, int numConstraints, const btContactSolverInfo & info, btIDebugDraw * debugDrawer, btStackAlloc * stackAlloc, btDispatcher * dispatcher)
+{
+	if (_Solvers.size() == 1 || (info.m_solverMode & SOLVER_RANDMIZE_ORDER))
+		return _Solvers[0]->solveGroup(bodies, numBodies, manifolds, numManifolds, constraints, numConstraints, info, debugDrawer, stackAlloc, dispatcher);
+
+	// The arrays belong to the world and are reused for the next batch
+	Batch batch;
+	batch.Bodies = _Bodies.size();
+	batch.NumBodies = numBodies;
+	batch.Manifolds = _Manifolds.size();
+	batch.NumManifolds = numManifolds;
+	batch.Constraints = _Constraints.size();
+	batch.NumConstraints = numConstraints;
+	_Batches.push_back(batch);
+
+	_Bodies.insert(_Bodies.end(), bodies, bodies + numBodies);
+	_Manifolds.insert(_Manifolds.end(), manifolds, manifolds + numManifolds);
+	_Constraints.insert(_Constraints.end(), constraints, constraints + numConstraints);
+	_Dispatcher = dispatcher;
+
+	return 0;
+}
+
+void ParallelSolver::allSolved(const btContactSolverInfo & info, btIDebugDraw * debugDrawer, btStackAlloc * stackAlloc)
+{
+	const int count = _Batches.size();
+
+	if (count > 1)
+	{
+		// One contiguous range of batches per thread, with about the same
+		// number of manifolds and constraints in each
+		const int ranges = _Solvers.size();
+		long long total = 0;
+		BOOST_FOREACH(Batch const & batch, _Batches)
+			total += batch.NumManifolds + batch.NumConstraints;
+
+		_Bounds.assign(1, 0);
+		long long done = 0;
+		for(int i = 0; i < count; ++i)
+		{
+			if ((int)_Bounds.size() < ranges && done * ranges >= total * (int)_Bounds.size())
+				_Bounds.push_back(i);
+			done += _Batches[i].NumManifolds + _Batches[i].NumConstraints;
+		}
+		_Bounds.resize(ranges + 1, count);
+
+		_Info = &info;
+		_DebugDrawer = debugDrawer;
+		_StackAlloc = stackAlloc;
+		_Jobs.Run(_Ranges);
+	}
+	else if (count)
+	{
+		solveRange(*_Solvers[0], 0, count, info, debugDrawer, stackAlloc);
+	}
+
+	_Batches.clear();
+	_Bodies.clear();
+	_Manifolds.clear();
+	_Constraints.clear();
+
+	btSequentialImpulseConstraintSolver::allSolved(info, debugDrawer, stackAlloc);
+}
+
+void ParallelSolver::reset()
+{
+	btSequentialImpulseConstraintSolver::reset();
+	BOOST_FOREACH(std::unique_ptr<btSequentialImpulseConstraintSolver> & solver, _Solvers)
+		solver->reset();
+}
+
+void ParallelSolver::solveRange(btSequentialImpulseConstraintSolver & solver, int first, int last, const btContactSolverInfo & info, btIDebugDraw * debugDrawer, btStackAlloc * stackAlloc)
+{
+	for(int i = first; i < last; ++i)
+	{
+		Batch const & batch = _Batches[i];
+
+		solver.solveGroup(
+			_Bodies.data() + batch.Bodies, batch.NumBodies,
+			_Manifolds.data() + batch.Manifolds, batch.NumManifolds,
+			_Constraints.data() + batch.Constraints, batch.NumConstraints,
+			info, debugDrawer, stackAlloc, _Dispatcher);
+	}
+}
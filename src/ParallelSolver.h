@@ -0,0 +1,92 @@
+/*
+    Copyright (C) 2012  Guillaume Meunier <guillaume.meunier@centraliens.net>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, version 3 of the License.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef PARALLELSOLVER_H
+#define PARALLELSOLVER_H
+
+#include "bullet/BulletDynamics/ConstraintSolver/btSequentialImpulseConstraintSolver.h"
+#include "JobSystem.h"
+
+#include <memory>
+#include <vector>
+
+// Constraint solver solving the simulation islands on the threads of a job
+// system.
+// btDiscreteDynamicsWorld still builds the islands and merges the small
+// ones in batches, but solveGroup() only records the batches: they are
+// solved by allSolved(), which the world calls once all of them are known,
+// with one job and one btSequentialImpulseConstraintSolver per thread.
+//
+// Two batches share no dynamic body, manifold nor constraint, and a solver
+// keeps nothing from one batch to the next. They do share the static
+// bodies: Bullet 2.79 solves against the static btRigidBodys of the level
+// and against its static getFixedBody(), and each solver writes their
+// velocity changes (and the mass of the fixed body) during its setup. The
+// values written are always null, but these writes race, as do the
+// increments of gNumSplitImpulseRecoveries: the results are not checked to
+// be independent of the number of threads.
+//
+// The random order of SOLVER_RANDMIZE_ORDER depends on the previous
+// batches, so batches are solved at once on the calling thread in that
+// mode.
+class ParallelSolver : public btSequentialImpulseConstraintSolver
+{
+public:
+	ParallelSolver(JobSystem & jobs);
+	virtual ~ParallelSolver();
+
+	int GetThreads() const
+	{
+		return _Solvers.size();
+	}
+
+	virtual btScalar solveGroup(btCollisionObject ** bodies, int numBodies, btPersistentManifold ** manifolds, int numManifolds, btTypedConstraint ** constraints, int numConstraints, const btContactSolverInfo & info, btIDebugDraw * debugDrawer, btStackAlloc * stackAlloc, btDispatcher * dispatcher);
+	virtual void allSolved(const btContactSolverInfo & info, btIDebugDraw * debugDrawer, btStackAlloc * stackAlloc);
+	virtual void reset();
+
+private:
+	// One solver per thread, the first one for the batches solved at once
+	std::vector<std::unique_ptr<btSequentialImpulseConstraintSolver> > _Solvers;
+
+	// One job per solver, on the ranges of batches in _Bounds
+	JobSystem & _Jobs;
+	JobGraph _Ranges;
+	std::vector<int> _Bounds;
+	btContactSolverInfo const * _Info;
+	btIDebugDraw * _DebugDrawer;
+	btStackAlloc * _StackAlloc;
+
+	// Batch recorded by solveGroup(), as offsets in the arrays below
+	struct Batch
+	{
+		int Bodies, NumBodies;
+		int Manifolds, NumManifolds;
+		int Constraints, NumConstraints;
+	};
+
+	std::vector<Batch> _Batches;
+	std::vector<btCollisionObject *> _Bodies;
+	std::vector<btPersistentManifold *> _Manifolds;
+	std::vector<btTypedConstraint *> _Constraints;
+	btDispatcher * _Dispatcher;
+
+	ParallelSolver(ParallelSolver const &);
+	ParallelSolver & operator=(ParallelSolver const &);
+
+	void solveRange(btSequentialImpulseConstraintSolver & solver, int first, int last, const btContactSolverInfo & info, btIDebugDraw * debugDrawer, btStackAlloc * stackAlloc);
+};
+
+#endif // PARALLELSOLVER_H
@@ -0,0 +1,222 @@
+#include "BuildArena.h"
+#include "Recast/RecastAlloc.h"
+
+#include <boost/thread/tss.hpp>
+
+#include <algorithm>
+#include <cstdlib>
+#include <string.h>
+
+namespace Pathfinding
+{
+static const size_t alignment = 16;
+
+// The arenas belong to the navmesh build, not to the threads
+static void nocleanup(BuildArena *)
+{
+}
+
+static boost::thread_specific_ptr<BuildArena> current(nocleanup);
+
+static void * arenaAlloc(int size, rcAllocHint hint)
+{
+	BuildArena * arena = current.get();
+
+	if (arena && hint == RC_ALLOC_TEMP)
+		return arena->Allocate(size);
+
+	if (arena)
+		arena->counters.PermBytes[arena->GetStage()] += size;
+
+	return malloc(size);
+}
+
+static void arenaFree(void * ptr)
+{
+	BuildArena * arena = current.get();
+
+	if (!arena || !arena->Free(ptr))
+		free(ptr);
+}
+
+const char * BuildArena::StageName(Stage stage)
+{
+	static const char * names[Stages] = {
+		"heightfield",
+		"compact heightfield",
+		"regions",
+		"contours",
+		"polygon mesh",
+		"detail mesh"
+	};
+
+	return names[stage];
+}
+
+BuildArena::Install::Install()
+{
+	rcAllocSetCustom(arenaAlloc, arenaFree);
+}
+
+BuildArena::Install::~Install()
+{
+	rcAllocSetCustom(0, 0);
+}
+
+BuildArena::Scope::Scope(BuildArena & _arena) : arena(_arena)
+{
+	current.reset(&arena);
+}
+
+BuildArena::Scope::~Scope()
+{
+	current.reset();
+	arena.Reset();
+}
+
+void BuildArena::SetStage(Stage stage)
+{
+	BuildArena * arena = current.get();
+
+	if (arena)
+		arena->stage = stage;
+}
+
+BuildArena::Counters::Counters() :
+	TempBytes(0),
+	TempAllocations(0),
+	TempPeak(0)
+{
+	std::fill(PermBytes, PermBytes + Stages, 0);
+}
+
+void BuildArena::Counters::Merge(Counters const & other)
+{
+	for(int i = 0; i < Stages; ++i)
+		PermBytes[i] += other.PermBytes[i];
+
+	TempBytes += other.TempBytes;
+	TempAllocations += other.TempAllocations;
+	TempPeak = std::max(TempPeak, other.TempPeak);
+}
+
+BuildArena::BuildArena(size_t _blocksize) :
+	blocksize(_blocksize),
+	used(0),
+	top(0),
+	last(0),
+	stage(Heightfield)
+{
+}
+
+BuildArena::~BuildArena()
+{
+	for(size_t i = 0; i < blocks.size(); ++i)
+		free(blocks[i].data);
+}
+
+void * BuildArena::Allocate(size_t size)
+{
+	size = (size + alignment - 1) & ~(alignment - 1);
+
+	if (blocks.empty() || top + size > blocks.back().size)
+	{
+		if (!blocks.empty())
+			used += top;
+
+		Block block;
+		block.size = std::max(blocksize, size);
+		block.data = (char *)malloc(block.size);
+
+		// Recast reports the failure
+		if (!block.data)
+			return 0;
+
+		blocks.push_back(block);
+		top = 0;
+	}
+
+	last = blocks.back().data + top;
+	top += size;
+
+	counters.TempBytes += size;
+	counters.TempAllocations++;
+	counters.TempPeak = std::max(counters.TempPeak, used + top);
+
+	return last;
+}
+
+bool BuildArena::Free(void * ptr)
+{
+	char * p = (char *)ptr;
+
+	// Recast often frees the last temporary buffer first, its space is
+	// given back
+	if (p == last)
+	{
+		top = p - blocks.back().data;
+		last = 0;
+		return true;
+	}
+
+	for(size_t i = 0; i < blocks.size(); ++i)
+	{
+		if (p >= blocks[i].data && p < blocks[i].data + blocks[i].size)
+			return true;
+	}
+
+	return false;
+}
+
+void BuildArena::Reset()
+{
+	// Merge the blocks, so that the next tile fits in one
+	if (blocks.size() > 1)
+	{
+		size_t size = 0;
+		for(size_t i = 0; i < blocks.size(); ++i)
+		{
+			size += blocks[i].size;
+			free(blocks[i].data);
+		}
+
+		blocks.clear();
+		blocksize = std::max(blocksize, size);
+	}
+
+	used = 0;
+	top = 0;
+	last = 0;
+}
+
+
+BuildArena::Pool::Pool(int count)
+{
+	for(int i = 0; i < count; ++i)
+	{
+		arenas.push_back(std::unique_ptr<BuildArena>(new BuildArena));
+		available.push_back(arenas.back().get());
+	}
+}
+
+BuildArena::Pool::Lease::Lease(Pool & _pool) : pool(_pool)
+{
+	std::lock_guard<std::mutex> lock(pool.mutex);
+	arena = pool.available.back();
+	pool.available.pop_back();
+}
+
+BuildArena::Pool::Lease::~Lease()
+{
+	std::lock_guard<std::mutex> lock(pool.mutex);
+	pool.available.push_back(arena);
+}
+
+BuildArena::Counters BuildArena::Pool::GetCounters() const
+{
+	Counters total;
+	for(size_t i = 0; i < arenas.size(); ++i)
+		total.Merge(arenas[i]->counters);
+	return total;
+}
+}
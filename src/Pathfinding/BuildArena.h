@@ -0,0 +1,145 @@
+// -*- c++ -*-
+
+#ifndef BUILDARENA_H
+#define BUILDARENA_H
+
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace Pathfinding
+{
+// Recast allocator used while the navmesh is built. Temporary allocations
+// made by a thread bound to an arena are served from large blocks by
+// moving a pointer, freeing them does nothing (except for the last one),
+// and the whole arena is reset when the thread is done with a tile.
+// Permanent allocations still use malloc, they are only counted by build
+// stage.
+class BuildArena
+{
+public:
+	enum Stage
+	{
+		Heightfield,
+		CompactHeightfield,
+		Regions,
+		Contours,
+		PolyMesh,
+		DetailMesh,
+		Stages
+	};
+
+	static const char * StageName(Stage stage);
+
+	// Installs the allocator in Recast for the lifetime of the object.
+	// The Recast allocator is global: only one may exist at a time.
+	class Install
+	{
+		Install(Install const &);
+		Install & operator=(Install const &);
+
+	public:
+		Install();
+		~Install();
+	};
+
+	// Binds the arena to the calling thread for the lifetime of the
+	// object, and resets it at the end
+	class Scope
+	{
+		BuildArena & arena;
+
+		Scope(Scope const &);
+		Scope & operator=(Scope const &);
+
+	public:
+		Scope(BuildArena & arena);
+		~Scope();
+	};
+
+	struct Counters
+	{
+		// Bytes allocated by Recast for each stage
+		size_t PermBytes[Stages];
+
+		// Temporary bytes and allocations served, and largest size an
+		// arena reached for one tile
+		size_t TempBytes;
+		int TempAllocations;
+		size_t TempPeak;
+
+		Counters();
+		void Merge(Counters const & other);
+	};
+
+	// One arena per build thread, leased by a tile while it is built
+	class Pool
+	{
+		std::vector<std::unique_ptr<BuildArena> > arenas;
+		std::vector<BuildArena *> available;
+		std::mutex mutex;
+
+		Pool(Pool const &);
+		Pool & operator=(Pool const &);
+
+	public:
+		class Lease
+		{
+			Pool & pool;
+
+			Lease(Lease const &);
+			Lease & operator=(Lease const &);
+
+		public:
+			BuildArena * arena;
+
+			Lease(Pool & pool);
+			~Lease();
+		};
+
+		Pool(int count);
+
+		// Sum of the counters of every arena
+		Counters GetCounters() const;
+	};
+
+	// Stage of the arena bound to the calling thread, the permanent
+	// allocations are counted in it
+	static void SetStage(Stage stage);
+
+	Stage GetStage() const
+	{
+		return stage;
+	}
+
+	Counters counters;
+
+	BuildArena(size_t blocksize = 1 << 20);
+	~BuildArena();
+
+	void * Allocate(size_t size);
+	// Returns false if ptr does not come from the arena
+	bool Free(void * ptr);
+	void Reset();
+
+private:
+	struct Block
+	{
+		char * data;
+		size_t size;
+	};
+
+	std::vector<Block> blocks;
+	size_t blocksize;
+	size_t used;
+	size_t top;
+	char * last;
+	Stage stage;
+
+	BuildArena(BuildArena const &);
+	BuildArena & operator=(BuildArena const &);
+};
+}
+
+#endif // BUILDARENA_H
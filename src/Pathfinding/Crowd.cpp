@@ -0,0 +1,419 @@
+#include "Crowd.h"
+
+#include <algorithm>
+
+#define _USE_MATH_DEFINES
+#include <math.h>
+
+namespace Pathfinding
+{
+// Time between two corridor updates of an agent
+static const float replanperiod = 0.1;
+
+// Corners closer than this are considered reached
+static const float cornerdistance = 0.2;
+
+static Vertex flatten(Vertex const & v)
+{
+	return Vertex(v.x, 0, v.z);
+}
+
+Crowd::Crowd(NavMesh const & _navmesh, PathScheduler & _scheduler) :
+	NeighbourRange(4),
+	MaxNeighbours(6),
+	TimeHorizon(2.5),
+	SampleRings(3),
+	SampleDirections(12),
+	WeightDesired(2),
+	WeightCurrent(0.75),
+	WeightCollision(2.5),
+	SlowDownDistance(1),
+	Avoidance(true),
+	navmesh(_navmesh),
+	scheduler(_scheduler)
+{
+}
+
+Crowd::~Crowd()
+{
+}
+
+Crowd::Agent & Crowd::get(AgentRef agent) const
+{
+	if (agent < 0 || agent >= (int)agents.size() || !agents[agent])
+		throw std::out_of_range("Pathfinding::Crowd: invalid agent");
+
+	return *agents[agent];
+}
+
+Crowd::AgentRef Crowd::Add(Vertex const & position, float radius, float maxspeed)
+{
+	std::unique_ptr<Agent> agent(new Agent);
+	agent->radius = radius;
+	agent->maxspeed = maxspeed;
+	agent->position = position;
+	agent->velocity = Vertex::ZERO;
+	agent->preferred = Vertex::ZERO;
+	agent->desired = Vertex::ZERO;
+	agent->hastarget = false;
+	agent->target = position;
+	agent->field = 0;
+	agent->corner = 0;
+	agent->pathage = replanperiod;
+	agent->revision = 0;
+	agent->next = -1;
+
+	AgentRef ref;
+	if (freeagents.empty())
+	{
+		ref = agents.size();
+		agents.push_back(std::move(agent));
+	}
+	else
+	{
+		ref = freeagents.back();
+		freeagents.pop_back();
+		agents[ref] = std::move(agent);
+	}
+
+	return ref;
+}
+
+void Crowd::Remove(AgentRef agent)
+{
+	get(agent);
+	agents[agent].reset();
+	freeagents.push_back(agent);
+}
+
+void Crowd::SetState(AgentRef ref, Vertex const & position, Vertex const & velocity)
+{
+	Agent & agent = get(ref);
+	agent.position = position;
+	agent.velocity = flatten(velocity);
+}
+
+void Crowd::SetTarget(AgentRef ref, Vertex const & target)
+{
+	Agent & agent = get(ref);
+
+	if (agent.field)
+	{
+		agent.field = 0;
+		agent.path = NavMesh::Path();
+		agent.pathage = replanperiod;
+	}
+
+	agent.hastarget = true;
+	agent.target = target;
+}
+
+void Crowd::SetTarget(AgentRef ref, GoalField const & field)
+{
+	Agent & agent = get(ref);
+	agent.hastarget = true;
+
+	// Set again at every tick while the field is valid
+	if (agent.field == &field)
+		return;
+
+	agent.field = &field;
+	agent.request.reset();
+	agent.corridor.reset();
+}
+
+void Crowd::ClearTarget(AgentRef ref)
+{
+	Agent & agent = get(ref);
+	agent.hastarget = false;
+	agent.field = 0;
+	agent.request.reset();
+	agent.corridor.reset();
+	agent.path = NavMesh::Path();
+}
+
+Vertex const & Crowd::GetVelocity(AgentRef agent) const
+{
+	return get(agent).desired;
+}
+
+NavMesh::Path const & Crowd::GetPath(AgentRef agent) const
+{
+	return get(agent).path;
+}
+
+// Same planning as a single CharacterController: the corridor is patched
+// while it can follow the agent and its target, and a request is sent to
+// the scheduler when it cannot
+void Crowd::updatePath(Agent & agent, float dt)
+{
+	agent.pathage += dt;
+
+	if (agent.field)
+	{
+		if (agent.field->IsValid())
+		{
+			agent.path = agent.field->GetPath(agent.position);
+			agent.corner = 0;
+			agent.target = agent.field->GetGoal();
+		}
+		return;
+	}
+
+	if (agent.request)
+	{
+		// Follow the partial path while the scheduler is still working on
+		// it, from its start each time it is replaced
+		if (agent.request->GetStatus() != PathScheduler::Queued && agent.request->GetRevision() != agent.revision)
+		{
+			agent.revision = agent.request->GetRevision();
+			agent.path = agent.request->GetPath();
+			agent.corner = 0;
+		}
+
+		if (agent.request->Done())
+		{
+			if (!agent.corridor)
+				agent.corridor.reset(new PathCorridor(navmesh));
+			agent.corridor->SetPath(agent.request->GetPath());
+			agent.request.reset();
+		}
+
+		return;
+	}
+
+	if (agent.pathage < replanperiod)
+		return;
+
+	if (agent.corridor && agent.corridor->MovePosition(agent.position) && agent.corridor->MoveTarget(agent.target) && agent.corridor->IsValid())
+	{
+		agent.path = agent.corridor->GetPath();
+		agent.corner = 0;
+	}
+	else
+	{
+		agent.request = scheduler.Submit(agent.position, agent.target);
+		agent.revision = 0;
+	}
+
+	agent.pathage = 0;
+}
+
+void Crowd::updatePreferred(Agent & agent)
+{
+	agent.preferred = Vertex::ZERO;
+
+	if (!agent.hastarget || agent.path.size() < 2)
+		return;
+
+	// Skip the corners already reached, or passed since the path was found
+	const Vertex position = flatten(agent.position);
+	agent.corner = agent.path.NextCorner(position, agent.corner, cornerdistance);
+
+	Vertex direction = flatten(agent.path[agent.corner]) - position;
+	float remaining = direction.normalise();
+	for(size_t i = agent.corner; i + 1 < agent.path.size(); ++i)
+		remaining += agent.path[i].distance(agent.path[i + 1]);
+
+	// A goal field path may stop short of the goal
+	Vertex end = agent.path[agent.path.size() - 1];
+	float speed = agent.maxspeed;
+	if (flatten(end).squaredDistance(flatten(agent.target)) < cornerdistance * cornerdistance && remaining < SlowDownDistance)
+		speed *= remaining / SlowDownDistance;
+
+	agent.preferred = direction * speed;
+}
+
+size_t Crowd::bucket(int x, int z) const
+{
+	return ((unsigned int)x * 73856093u ^ (unsigned int)z * 19349663u) & (grid.size() - 1);
+}
+
+void Crowd::buildGrid()
+{
+	size_t size = 1;
+	while(size < 2 * agents.size())
+		size *= 2;
+
+	grid.assign(size, -1);
+
+	for(size_t i = 0; i < agents.size(); ++i)
+	{
+		if (!agents[i])
+			continue;
+
+		Agent & agent = *agents[i];
+		size_t b = bucket(floorf(agent.position.x / NeighbourRange), floorf(agent.position.z / NeighbourRange));
+		agent.next = grid[b];
+		grid[b] = i;
+	}
+}
+
+void Crowd::findNeighbours(AgentRef ref)
+{
+	Agent & agent = *agents[ref];
+	agent.neighbours.clear();
+
+	const int cx = floorf(agent.position.x / NeighbourRange);
+	const int cz = floorf(agent.position.z / NeighbourRange);
+
+	for(int z = cz - 1; z <= cz + 1; ++z)
+	{
+		for(int x = cx - 1; x <= cx + 1; ++x)
+		{
+			// Different cells can share a bucket, the distance check
+			// below drops the agents from the other cells
+			for(int i = grid[bucket(x, z)]; i >= 0; i = agents[i]->next)
+			{
+				Agent const & other = *agents[i];
+				if (i == ref ||
+				    floorf(other.position.x / NeighbourRange) != x ||
+				    floorf(other.position.z / NeighbourRange) != z)
+					continue;
+
+				float distance = flatten(other.position).distance(flatten(agent.position)) - agent.radius - other.radius;
+				if (distance > NeighbourRange)
+					continue;
+
+				// Keep the nearest ones, sorted by distance
+				std::pair<float, int> neighbour(distance, i);
+				auto it = std::upper_bound(agent.neighbours.begin(), agent.neighbours.end(), neighbour);
+				if (it - agent.neighbours.begin() < MaxNeighbours)
+				{
+					agent.neighbours.insert(it, neighbour);
+					if ((int)agent.neighbours.size() > MaxNeighbours)
+						agent.neighbours.pop_back();
+				}
+			}
+		}
+	}
+}
+
+// Cost of a candidate velocity, RVO: each agent is assumed to take half of
+// the avoidance, so the relative velocity is 2 * candidate - velocity
+// - neighbour velocity
+float Crowd::cost(Agent const & agent, Vertex const & candidate) const
+{
+	float collision = TimeHorizon;
+
+	for(size_t i = 0; i < agent.neighbours.size(); ++i)
+	{
+		Agent const & other = *agents[agent.neighbours[i].second];
+
+		const Vertex p = flatten(other.position - agent.position);
+		const Vertex v = candidate * 2 - agent.velocity - other.velocity;
+		const float r = agent.radius + other.radius;
+
+		// Time at which |p - v t| = r
+		const float a = v.dotProduct(v);
+		const float b = p.dotProduct(v);
+		const float c = p.dotProduct(p) - r * r;
+
+		float t;
+		if (c < 0)
+		{
+			// Already overlapping: only moving apart is free
+			if (b <= 0)
+				continue;
+			t = 0;
+		}
+		else
+		{
+			const float d = b * b - a * c;
+			if (a < 1e-6 || d < 0)
+				continue;
+
+			t = (b - sqrtf(d)) / a;
+			if (t < 0)
+				continue;
+		}
+
+		collision = std::min(collision, t);
+	}
+
+	const float speed = std::max(agent.maxspeed, 0.01f);
+	return WeightDesired * candidate.distance(agent.preferred) / speed +
+	       WeightCurrent * candidate.distance(agent.velocity) / speed +
+	       WeightCollision / (0.1 + collision / TimeHorizon);
+}
+
+void Crowd::avoid(Agent & agent)
+{
+	if (agent.neighbours.empty())
+	{
+		agent.desired = agent.preferred;
+		return;
+	}
+
+	Vertex best = agent.preferred;
+	float bestcost = cost(agent, agent.preferred);
+
+	auto sample = [&](Vertex const & candidate)
+	{
+		float c = cost(agent, candidate);
+		if (c < bestcost)
+		{
+			bestcost = c;
+			best = candidate;
+		}
+	};
+
+	sample(Vertex::ZERO);
+
+	// Rings around the preferred direction, every other one rotated by
+	// half a step
+	const float heading = agent.preferred.squaredLength() > 1e-6 ?
+		atan2f(agent.preferred.z, agent.preferred.x) :
+		atan2f(agent.velocity.z, agent.velocity.x);
+
+	for(int ring = 1; ring <= SampleRings; ++ring)
+	{
+		const float speed = agent.maxspeed * ring / SampleRings;
+		const float offset = (ring % 2) ? 0 : M_PI / SampleDirections;
+
+		for(int i = 0; i < SampleDirections; ++i)
+		{
+			const float angle = heading + offset + 2 * M_PI * i / SampleDirections;
+			sample(Vertex(cosf(angle) * speed, 0, sinf(angle) * speed));
+		}
+	}
+
+	agent.desired = best;
+}
+
+void Crowd::Update(float dt)
+{
+	for(size_t i = 0; i < agents.size(); ++i)
+	{
+		if (agents[i])
+		{
+			updatePath(*agents[i], dt);
+			updatePreferred(*agents[i]);
+		}
+	}
+
+	if (!Avoidance)
+	{
+		for(size_t i = 0; i < agents.size(); ++i)
+		{
+			if (agents[i])
+				agents[i]->desired = agents[i]->preferred;
+		}
+		return;
+	}
+
+	buildGrid();
+
+	for(size_t i = 0; i < agents.size(); ++i)
+	{
+		if (agents[i])
+			findNeighbours(i);
+	}
+
+	for(size_t i = 0; i < agents.size(); ++i)
+	{
+		if (agents[i])
+			avoid(*agents[i]);
+	}
+}
+}
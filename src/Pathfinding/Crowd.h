@@ -0,0 +1,127 @@
+// -*- c++ -*-
+
+#ifndef CROWD_H
+#define CROWD_H
+
+#include "Pathfinding.h"
+#include "PathCorridor.h"
+#include "PathScheduler.h"
+#include "GoalField.h"
+
+namespace Pathfinding
+{
+// Steers a group of agents together: each agent follows its own corridor
+// or a shared goal field, and the velocities of all the agents are then
+// adjusted in one pass with reciprocal velocity obstacles so that they
+// walk around each other instead of relying on the physics to separate
+// them. Neighbours are found with a uniform grid rebuilt at every update.
+//
+// The crowd does not move the agents: their position and velocity are set
+// from the physics before Update(), which computes the velocity they
+// should try to reach.
+class Crowd
+{
+public:
+	typedef int AgentRef;
+
+	// Neighbours closer than NeighbourRange (between their edges) are
+	// avoided, at most MaxNeighbours of them, the nearest ones
+	float NeighbourRange;
+	int MaxNeighbours;
+
+	// Collisions further than TimeHorizon seconds are ignored
+	float TimeHorizon;
+
+	// Candidate velocities: SampleRings speeds times SampleDirections
+	// directions around the preferred velocity
+	int SampleRings;
+	int SampleDirections;
+
+	// Weights of the distance to the preferred and current velocities, and
+	// of the time to collision, in the cost of a candidate velocity
+	float WeightDesired;
+	float WeightCurrent;
+	float WeightCollision;
+
+	// Agents slow down closer than this to their target
+	float SlowDownDistance;
+
+	// Disables local avoidance, the agents go at their preferred velocity
+	bool Avoidance;
+
+	Crowd(NavMesh const & navmesh, PathScheduler & scheduler);
+	~Crowd();
+
+	AgentRef Add(Vertex const & position, float radius, float maxspeed);
+	void Remove(AgentRef agent);
+
+	// State of the agent from the physics
+	void SetState(AgentRef agent, Vertex const & position, Vertex const & velocity);
+
+	// The agent keeps a corridor to the target, or follows the goal field,
+	// which must live as long as the agent follows it
+	void SetTarget(AgentRef agent, Vertex const & target);
+	void SetTarget(AgentRef agent, GoalField const & field);
+	void ClearTarget(AgentRef agent);
+
+	void Update(float dt);
+
+	// Velocity the agent should try to reach, after avoidance
+	Vertex const & GetVelocity(AgentRef agent) const;
+
+	// Path the agent is following
+	NavMesh::Path const & GetPath(AgentRef agent) const;
+
+	size_t size() const
+	{
+		return agents.size() - freeagents.size();
+	}
+
+private:
+	struct Agent
+	{
+		float radius;
+		float maxspeed;
+		Vertex position;
+		Vertex velocity;
+		Vertex preferred;
+		Vertex desired;
+
+		bool hastarget;
+		Vertex target;
+		GoalField const * field;
+		// Only while the agent follows a target without a goal field
+		std::unique_ptr<PathCorridor> corridor;
+		PathScheduler::RequestPtr request;
+		int revision;
+		NavMesh::Path path;
+		size_t corner;
+		float pathage;
+
+		std::vector<std::pair<float, int> > neighbours;
+		int next;
+
+	};
+
+	NavMesh const & navmesh;
+	PathScheduler & scheduler;
+
+	std::vector<std::unique_ptr<Agent> > agents;
+	std::vector<AgentRef> freeagents;
+
+	// Buckets of the uniform grid, agents in the same bucket are chained
+	// by Agent::next
+	std::vector<int> grid;
+
+	Agent & get(AgentRef agent) const;
+	void updatePath(Agent & agent, float dt);
+	void updatePreferred(Agent & agent);
+	void buildGrid();
+	size_t bucket(int x, int z) const;
+	void findNeighbours(AgentRef agent);
+	float cost(Agent const & agent, Vertex const & candidate) const;
+	void avoid(Agent & agent);
+};
+}
+
+#endif // CROWD_H
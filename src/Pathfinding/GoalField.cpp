@@ -0,0 +1,239 @@
+#include "GoalField.h"
+#include "Detour/DetourCommon.h"
+
+#include <queue>
+#include <functional>
+
+namespace Pathfinding
+{
+GoalField::GoalField(NavMesh const & _navmesh) :
+	Lookahead(4),
+	navmesh(_navmesh),
+	generation(0),
+	goalpoly(0)
+{
+}
+
+size_t GoalField::getIndex(const dtNavMesh * mesh, dtPolyRef ref) const
+{
+	unsigned int salt, it, ip;
+	mesh->decodePolyId(ref, salt, it, ip);
+	return it < offsets.size() ? offsets[it] + ip : nodes.size();
+}
+
+GoalField::Node const * GoalField::getNode(dtPolyRef ref) const
+{
+	if (!ref || !goalpoly)
+		return 0;
+
+	size_t index = getIndex(navmesh.GetQueryContext().query().getAttachedNavMesh(), ref);
+	if (index >= nodes.size() || nodes[index].generation != generation)
+		return 0;
+
+	return &nodes[index];
+}
+
+dtPolyRef GoalField::FindPoly(Vertex const & position) const
+{
+	float pos[3];
+	float extent[3];
+	NavMesh::toRecastVertex(position, pos);
+	NavMesh::toRecastVertex(navmesh.QueryExtent, extent);
+
+	dtPolyRef ref = 0;
+	if (dtStatusFailed(navmesh.GetQueryContext().query().findNearestPoly(pos, extent, &filter, &ref, 0)))
+		return 0;
+
+	return ref;
+}
+
+bool GoalField::Build(Vertex const & _goal)
+{
+	dtNavMeshQuery & query = navmesh.GetQueryContext().query();
+	const dtNavMesh * mesh = query.getAttachedNavMesh();
+
+	float pos[3];
+	float extent[3];
+	float nearest[3];
+	NavMesh::toRecastVertex(_goal, pos);
+	NavMesh::toRecastVertex(navmesh.QueryExtent, extent);
+
+	dtPolyRef ref = 0;
+	if (dtStatusFailed(query.findNearestPoly(pos, extent, &filter, &ref, nearest)) || !ref)
+	{
+		goalpoly = 0;
+		return false;
+	}
+
+	goal = _goal;
+
+	if (ref == goalpoly)
+		return true;
+
+	// Nodes of each tile are stored after the ones of the previous tiles
+	size_t size = 0;
+	offsets.resize(mesh->getMaxTiles());
+	for(int i = 0; i < mesh->getMaxTiles(); ++i)
+	{
+		const dtMeshTile * tile = mesh->getTile(i);
+		offsets[i] = size;
+		if (tile->header)
+			size += tile->header->polyCount;
+	}
+
+	if (size != nodes.size())
+	{
+		nodes.assign(size, Node());
+		generation = 0;
+	}
+
+	++generation;
+	goalpoly = ref;
+
+	Node & start = nodes[getIndex(mesh, ref)];
+	start.next = 0;
+	start.cost = 0;
+	start.generation = generation;
+	dtVcopy(start.pos, nearest);
+	dtVcopy(start.left, nearest);
+	dtVcopy(start.right, nearest);
+
+	typedef std::pair<float, dtPolyRef> OpenNode;
+	std::priority_queue<OpenNode, std::vector<OpenNode>, std::greater<OpenNode> > open;
+	open.push(OpenNode(0, ref));
+
+	while(!open.empty())
+	{
+		OpenNode top = open.top();
+		open.pop();
+
+		Node const & current = *getNode(top.second);
+		if (top.first > current.cost)
+			continue;
+
+		const dtMeshTile * tile = 0;
+		const dtPoly * poly = 0;
+		mesh->getTileAndPolyByRefUnsafe(top.second, &tile, &poly);
+
+		for(unsigned int i = poly->firstLink; i != DT_NULL_LINK; i = tile->links[i].next)
+		{
+			dtLink const & link = tile->links[i];
+			if (!link.ref)
+				continue;
+
+			const dtMeshTile * neighbourTile = 0;
+			const dtPoly * neighbourPoly = 0;
+			mesh->getTileAndPolyByRefUnsafe(link.ref, &neighbourTile, &neighbourPoly);
+
+			// dtQueryFilter::passFilter() is not visible outside Detour
+			if (neighbourPoly->getType() != DT_POLYTYPE_GROUND ||
+			    !(neighbourPoly->flags & filter.getIncludeFlags()) ||
+			    (neighbourPoly->flags & filter.getExcludeFlags()))
+				continue;
+
+			// Portal shared by the two polygons, clamped to the overlapping
+			// part of the edge for links across tile borders
+			const float * v0 = &tile->verts[poly->verts[link.edge] * 3];
+			const float * v1 = &tile->verts[poly->verts[(link.edge + 1) % poly->vertCount] * 3];
+			float left[3], right[3], mid[3];
+			if (link.side != 0xff && (link.bmin != 0 || link.bmax != 255))
+			{
+				const float s = 1.0f / 255.0f;
+				dtVlerp(left, v0, v1, link.bmin * s);
+				dtVlerp(right, v0, v1, link.bmax * s);
+			}
+			else
+			{
+				dtVcopy(left, v0);
+				dtVcopy(right, v1);
+			}
+			dtVlerp(mid, left, right, 0.5f);
+
+			float cost = current.cost + dtVdist(current.pos, mid) * filter.getAreaCost(neighbourPoly->getArea());
+
+			Node & neighbour = nodes[getIndex(mesh, link.ref)];
+
+			if (neighbour.generation == generation && neighbour.cost <= cost)
+				continue;
+
+			neighbour.next = top.second;
+			neighbour.cost = cost;
+			neighbour.generation = generation;
+			dtVcopy(neighbour.pos, mid);
+			dtVcopy(neighbour.left, left);
+			dtVcopy(neighbour.right, right);
+
+			open.push(OpenNode(cost, link.ref));
+		}
+	}
+
+	return true;
+}
+
+dtPolyRef GoalField::GetNext(dtPolyRef poly) const
+{
+	Node const * node = getNode(poly);
+	return node ? node->next : 0;
+}
+
+float GoalField::GetCost(dtPolyRef poly) const
+{
+	Node const * node = getNode(poly);
+	return node ? node->cost : FLT_MAX;
+}
+
+// Point of the node's portal where the line from 'from' to the portal after
+// it crosses, so that agents cut corners instead of going through the middle
+// of every portal
+void GoalField::steer(Node const & node, const float * from, float * point) const
+{
+	Node const & next = *getNode(node.next);
+
+	float target[3];
+	if (next.next)
+		dtVcopy(target, next.pos);
+	else
+		NavMesh::toRecastVertex(goal, target);
+
+	const float d[2] = { node.right[0] - node.left[0], node.right[2] - node.left[2] };
+	const float e[2] = { target[0] - from[0], target[2] - from[2] };
+	const float w[2] = { from[0] - node.left[0], from[2] - node.left[2] };
+
+	float denom = d[0] * e[1] - d[1] * e[0];
+	float s;
+	if (fabsf(denom) > 1e-6f)
+		s = (w[0] * e[1] - w[1] * e[0]) / denom;
+	else
+		s = dtVdist2DSqr(node.left, target) < dtVdist2DSqr(node.right, target) ? 0 : 1;
+
+	dtVlerp(point, node.left, node.right, dtClamp(s, 0.0f, 1.0f));
+}
+
+NavMesh::Path GoalField::GetPath(Vertex const & position) const
+{
+	NavMesh::Path path;
+
+	Node const * node = getNode(FindPoly(position));
+	if (!node)
+		return path;
+
+	float from[3];
+	NavMesh::toRecastVertex(position, from);
+	path.vertices.push_back(position);
+
+	for(int i = 0; i < Lookahead && node->next; ++i)
+	{
+		float point[3];
+		steer(*node, from, point);
+		path.vertices.push_back(Vertex(point[0], point[1], point[2]));
+
+		dtVcopy(from, point);
+		node = getNode(node->next);
+	}
+
+	if (!node->next)
+		path.vertices.push_back(goal);
+
+	return path;
+}
+}
@@ -0,0 +1,87 @@
+// -*- c++ -*-
+
+#ifndef GOALFIELD_H
+#define GOALFIELD_H
+
+#include "Pathfinding.h"
+
+namespace Pathfinding
+{
+// Distance field over the navmesh polygons toward a single goal, computed
+// with one Dijkstra search from the goal polygon. Any number of agents can
+// then look up their next polygon and steering point without searching.
+class GoalField
+{
+public:
+	// Number of portals looked ahead by GetPath()
+	int Lookahead;
+
+	GoalField(NavMesh const & navmesh);
+
+	// Returns false if the goal is not on the navmesh. The search is only
+	// run again if the goal has moved to another polygon.
+	bool Build(Vertex const & goal);
+
+	// Forces the next call to Build() to run the search, must be called
+	// when the navmesh has been rebuilt
+	void Invalidate()
+	{
+		goalpoly = 0;
+	}
+
+	bool IsValid() const
+	{
+		return goalpoly != 0;
+	}
+
+	Vertex const & GetGoal() const
+	{
+		return goal;
+	}
+
+	dtPolyRef GetGoalPoly() const
+	{
+		return goalpoly;
+	}
+
+	dtPolyRef FindPoly(Vertex const & position) const;
+
+	// Next polygon toward the goal, 0 if poly has not been reached by the
+	// search or is the goal polygon
+	dtPolyRef GetNext(dtPolyRef poly) const;
+
+	// Distance to the goal along the portals, FLT_MAX if poly has not been
+	// reached by the search
+	float GetCost(dtPolyRef poly) const;
+
+	// Short path from position through the next portals, empty if position
+	// is not connected to the goal
+	NavMesh::Path GetPath(Vertex const & position) const;
+
+private:
+	struct Node
+	{
+		dtPolyRef next;
+		float cost;
+		float pos[3];
+		float left[3];
+		float right[3];
+		unsigned int generation;
+	};
+
+	NavMesh const & navmesh;
+	std::vector<Node> nodes;
+	unsigned int generation;
+	std::vector<size_t> offsets;
+
+	Vertex goal;
+	dtPolyRef goalpoly;
+	dtQueryFilter filter;
+
+	size_t getIndex(const dtNavMesh * mesh, dtPolyRef ref) const;
+	Node const * getNode(dtPolyRef ref) const;
+	void steer(Node const & node, const float * from, float * point) const;
+};
+}
+
+#endif // GOALFIELD_H
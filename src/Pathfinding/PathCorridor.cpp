@@ -0,0 +1,156 @@
+#include "PathCorridor.h"
+#include "Detour/DetourCommon.h"
+
+namespace Pathfinding
+{
+static const int maxvisited = 16;
+
+PathCorridor::PathCorridor(NavMesh const & _navmesh) :
+	MaxPolys(256),
+	Tolerance(1),
+	navmesh(_navmesh)
+{
+	Reset();
+}
+
+void PathCorridor::Reset()
+{
+	polys.clear();
+	dtVset(pos, 0, 0, 0);
+	dtVset(target, 0, 0, 0);
+}
+
+void PathCorridor::SetPath(NavMesh::Path const & path)
+{
+	if (path.empty() || path.polys().empty())
+	{
+		Reset();
+		return;
+	}
+
+	polys = path.polys();
+	NavMesh::toRecastVertex(path[0], pos);
+	NavMesh::toRecastVertex(path[path.size() - 1], target);
+}
+
+bool PathCorridor::moveAlongSurface(dtPolyRef start, float * from, Vertex const & _to, std::vector<dtPolyRef> & visited) const
+{
+	dtNavMeshQuery & query = navmesh.GetQueryContext().query();
+
+	float to[3];
+	float result[3];
+	NavMesh::toRecastVertex(_to, to);
+
+	dtPolyRef buffer[maxvisited];
+	int nvisited = 0;
+	if (dtStatusFailed(query.moveAlongSurface(start, from, to, &filter, result, buffer, &nvisited, maxvisited)) || nvisited == 0)
+		return false;
+
+	if (dtVdist2DSqr(result, to) > Tolerance * Tolerance)
+		return false;
+
+	query.getPolyHeight(buffer[nvisited - 1], result, &result[1]);
+	dtVcopy(from, result);
+	visited.assign(buffer, buffer + nvisited);
+	return true;
+}
+
+// The agent moved from the first polygon of the corridor through the
+// visited polygons: the corridor now starts at the last visited polygon
+// and goes back through them until it joins the old corridor
+void PathCorridor::mergeStartMoved(std::vector<dtPolyRef> const & visited)
+{
+	int furthestPath = -1;
+	int furthestVisited = -1;
+
+	for(int i = polys.size() - 1; i >= 0 && furthestPath < 0; --i)
+	{
+		for(int j = visited.size() - 1; j >= 0; --j)
+		{
+			if (polys[i] == visited[j])
+			{
+				furthestPath = i;
+				furthestVisited = j;
+			}
+		}
+	}
+
+	if (furthestPath < 0)
+		return;
+
+	std::vector<dtPolyRef> merged(visited.rbegin(), visited.rend() - furthestVisited);
+	merged.insert(merged.end(), polys.begin() + furthestPath + 1, polys.end());
+	polys.swap(merged);
+}
+
+// The target moved from the last polygon of the corridor: the corridor is
+// cut where it first meets the visited polygons and continues with them
+void PathCorridor::mergeEndMoved(std::vector<dtPolyRef> const & visited)
+{
+	int furthestPath = -1;
+	int furthestVisited = -1;
+
+	for(size_t i = 0; i < polys.size() && furthestPath < 0; ++i)
+	{
+		for(int j = visited.size() - 1; j >= 0; --j)
+		{
+			if (polys[i] == visited[j])
+			{
+				furthestPath = i;
+				furthestVisited = j;
+			}
+		}
+	}
+
+	if (furthestPath < 0)
+		return;
+
+	polys.resize(furthestPath + 1);
+	polys.insert(polys.end(), visited.begin() + furthestVisited + 1, visited.end());
+}
+
+bool PathCorridor::MovePosition(Vertex const & position)
+{
+	std::vector<dtPolyRef> visited;
+
+	if (polys.empty() || !moveAlongSurface(polys.front(), pos, position, visited))
+		return false;
+
+	mergeStartMoved(visited);
+	return true;
+}
+
+bool PathCorridor::MoveTarget(Vertex const & _target)
+{
+	std::vector<dtPolyRef> visited;
+
+	if (polys.empty() || !moveAlongSurface(polys.back(), target, _target, visited))
+		return false;
+
+	mergeEndMoved(visited);
+	return (int)polys.size() <= MaxPolys;
+}
+
+bool PathCorridor::IsValid() const
+{
+	if (polys.empty())
+		return false;
+
+	dtNavMeshQuery & query = navmesh.GetQueryContext().query();
+	for(size_t i = 0; i < polys.size(); ++i)
+	{
+		if (!query.isValidPolyRef(polys[i], &filter))
+			return false;
+	}
+
+	return true;
+}
+
+NavMesh::Path PathCorridor::GetPath() const
+{
+	if (polys.empty())
+		return NavMesh::Path();
+
+	return NavMesh::Path(navmesh.GetQueryContext(), pos, target, &polys[0], polys.size());
+}
+}
@@ -0,0 +1,63 @@
+// -*- c++ -*-
+
+#ifndef PATHCORRIDOR_H
+#define PATHCORRIDOR_H
+
+#include "Pathfinding.h"
+
+namespace Pathfinding
+{
+// Polygon corridor from an agent to its target, kept between queries.
+// When the agent or the target moves, the ends of the corridor are moved
+// along the navmesh surface instead of searching again; a new query is
+// only needed when the corridor cannot follow them any more.
+class PathCorridor
+{
+public:
+	// Maximum number of polygons in the corridor
+	int MaxPolys;
+
+	// How far the agent or the target may be from the point the corridor
+	// could move to before the corridor is considered invalid
+	float Tolerance;
+
+	PathCorridor(NavMesh const & navmesh);
+
+	void Reset();
+
+	// Replaces the corridor by the polygons of a path found by a query
+	void SetPath(NavMesh::Path const & path);
+
+	// Both return false if the corridor could not follow the move
+	bool MovePosition(Vertex const & position);
+	bool MoveTarget(Vertex const & target);
+
+	bool IsValid() const;
+
+	// Straight path along the corridor
+	NavMesh::Path GetPath() const;
+
+	bool empty() const
+	{
+		return polys.empty();
+	}
+
+	size_t size() const
+	{
+		return polys.size();
+	}
+
+private:
+	NavMesh const & navmesh;
+	std::vector<dtPolyRef> polys;
+	float pos[3];
+	float target[3];
+	dtQueryFilter filter;
+
+	bool moveAlongSurface(dtPolyRef start, float * from, Vertex const & to, std::vector<dtPolyRef> & visited) const;
+	void mergeStartMoved(std::vector<dtPolyRef> const & visited);
+	void mergeEndMoved(std::vector<dtPolyRef> const & visited);
+};
+}
+
+#endif // PATHCORRIDOR_H
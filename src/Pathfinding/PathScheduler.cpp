@@ -0,0 +1,200 @@
+#include "PathScheduler.h"
+#include "Detour/DetourCommon.h"
+#include "Detour/DetourNode.h"
+
+#include <algorithm>
+
+namespace Pathfinding
+{
+PathScheduler::Request::Request(Vertex const & _start, Vertex const & _end) :
+	startpoly(0),
+	endpoly(0),
+	status(Queued),
+	revision(0)
+{
+	NavMesh::toRecastVertex(_start, start);
+	NavMesh::toRecastVertex(_end, end);
+}
+
+PathScheduler::PathScheduler(NavMesh const & _navmesh) :
+	IterationBudget(1024),
+	navmesh(_navmesh),
+	context(_navmesh.CreateQueryContext())
+{
+}
+
+PathScheduler::RequestPtr PathScheduler::Submit(Vertex const & start, Vertex const & end)
+{
+	RequestPtr request(new Request(start, end));
+
+	if (navmesh.WorkerCount() > 0)
+		request->future = navmesh.QueryAsync(start, end);
+
+	queue.push_back(request);
+	return request;
+}
+
+bool PathScheduler::Start(Request & request)
+{
+	dtNavMeshQuery & query = context->query();
+
+	float extent[3];
+	NavMesh::toRecastVertex(navmesh.QueryExtent, extent);
+
+	if (dtStatusFailed(query.findNearestPoly(request.start, extent, &filter, &request.startpoly, 0)) || !request.startpoly)
+	{
+		std::cerr << "Warning: cannot find start poly (" << request.start[0] << ", " << request.start[1] << ", " << request.start[2] << ")\n";
+		return false;
+	}
+
+	if (dtStatusFailed(query.findNearestPoly(request.end, extent, &filter, &request.endpoly, 0)) || !request.endpoly)
+	{
+		std::cerr << "Warning: cannot find end poly (" << request.end[0] << ", " << request.end[1] << ", " << request.end[2] << ")\n";
+		return false;
+	}
+
+	if (dtStatusFailed(query.initSlicedFindPath(request.startpoly, request.endpoly, request.start, request.end, &filter)))
+		return false;
+
+	request.status = Running;
+	return true;
+}
+
+void PathScheduler::Finalize(Request & request, dtStatus status)
+{
+	dtNavMeshQuery & query = context->query();
+	dtPolyRef * polys = &context->polys[0];
+	int npolys = 0;
+
+	if (dtStatusSucceed(status))
+		status = query.finalizeSlicedFindPath(polys, &npolys, context->polys.size());
+
+	if (dtStatusFailed(status) || npolys == 0)
+	{
+		std::cerr << "Warning: findPath failed, status = " << status << "\n";
+		request.status = Failed;
+		request.path = NavMesh::Path();
+		++request.revision;
+		return;
+	}
+
+	float end[3];
+	dtVcopy(end, request.end);
+
+	if (polys[npolys - 1] != request.endpoly)
+		query.closestPointOnPoly(polys[npolys - 1], request.end, end);
+
+	request.path = NavMesh::Path(*context, request.start, end, polys, npolys);
+	++request.revision;
+	request.status = Complete;
+}
+
+// The sliced query cannot be finalized without ending it, so the partial
+// corridor is read back from the node pool: it ends at the node with the
+// lowest heuristic, like finalizeSlicedFindPathPartial() would return.
+void PathScheduler::UpdatePartialPath(Request & request)
+{
+	const dtNodePool * pool = context->query().getNodePool();
+	const dtNode * best = 0;
+	float bestheuristic = FLT_MAX;
+
+	for(int bucket = 0; bucket < pool->getHashSize(); ++bucket)
+	{
+		for(dtNodeIndex i = pool->getFirst(bucket); i != DT_NULL_IDX; i = pool->getNext(i))
+		{
+			const dtNode * node = pool->getNodeAtIdx(i + 1);
+			if (node->total - node->cost < bestheuristic)
+			{
+				bestheuristic = node->total - node->cost;
+				best = node;
+			}
+		}
+	}
+
+	if (!best) return;
+
+	dtPolyRef * polys = &context->polys[0];
+	const int maxpolys = context->polys.size();
+	int npolys = 0;
+
+	for(const dtNode * node = best; node && npolys < maxpolys; node = pool->getNodeAtIdx(node->pidx))
+		polys[npolys++] = node->id;
+
+	std::reverse(polys, polys + npolys);
+
+	request.path = NavMesh::Path(*context, request.start, best->pos, polys, npolys);
+	++request.revision;
+}
+
+void PathScheduler::UpdateAsync()
+{
+	std::deque<RequestPtr> pending;
+
+	while (!queue.empty())
+	{
+		RequestPtr request = queue.front();
+		queue.pop_front();
+
+		if (request.use_count() <= 1)
+			continue;
+
+		if (request->future.wait_for(std::chrono::seconds(0)) == std::future_status::ready)
+		{
+			request->path = request->future.get();
+			++request->revision;
+			request->status = request->path.empty() ? Failed : Complete;
+		}
+		else
+		{
+			pending.push_back(request);
+		}
+	}
+
+	queue.swap(pending);
+}
+
+void PathScheduler::Update()
+{
+	if (navmesh.WorkerCount() > 0)
+	{
+		UpdateAsync();
+		return;
+	}
+
+	dtNavMeshQuery & query = context->query();
+	int budget = IterationBudget;
+
+	while (budget > 0 && !queue.empty())
+	{
+		RequestPtr request = queue.front();
+
+		// Nobody is waiting for this request anymore
+		if (request.use_count() <= 2)
+		{
+			queue.pop_front();
+			continue;
+		}
+
+		if (request->status == Queued && !Start(*request))
+		{
+			request->status = Failed;
+			queue.pop_front();
+			continue;
+		}
+
+		int iterations = 0;
+		dtStatus status = query.updateSlicedFindPath(budget, &iterations);
+		budget -= std::max(iterations, 1);
+
+		if (dtStatusInProgress(status))
+		{
+			UpdatePartialPath(*request);
+		}
+		else
+		{
+			Finalize(*request, status);
+			queue.pop_front();
+		}
+	}
+}
+}
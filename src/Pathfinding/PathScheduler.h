@@ -0,0 +1,104 @@
+// -*- c++ -*-
+
+#ifndef PATHSCHEDULER_H
+#define PATHSCHEDULER_H
+
+#include "Pathfinding.h"
+
+#include <deque>
+
+namespace Pathfinding
+{
+// Runs path requests with Detour's sliced pathfinder, spending at most
+// IterationBudget A* iterations per call to Update(), so that the cost of
+// pathfinding per physics tick does not depend on the number of agents.
+// If the navmesh has worker threads, requests are run on them instead and
+// Update() only collects the finished ones.
+class PathScheduler
+{
+public:
+	enum Status
+	{
+		Queued,
+		Running,
+		Complete,
+		Failed
+	};
+
+	class Request
+	{
+		friend class PathScheduler;
+
+		float start[3];
+		float end[3];
+		dtPolyRef startpoly;
+		dtPolyRef endpoly;
+
+		Status status;
+		NavMesh::Path path;
+		int revision;
+		std::future<NavMesh::Path> future;
+
+	public:
+		Request(Vertex const & start, Vertex const & end);
+
+		Status GetStatus() const
+		{
+			return status;
+		}
+
+		bool Done() const
+		{
+			return status == Complete || status == Failed;
+		}
+
+		// While the request is running, this is the path to the polygon
+		// closest to the target found so far
+		NavMesh::Path const & GetPath() const
+		{
+			return path;
+		}
+
+		// Changes each time the path is replaced
+		int GetRevision() const
+		{
+			return revision;
+		}
+	};
+
+	typedef std::shared_ptr<Request> RequestPtr;
+
+	// Maximum number of A* iterations per call to Update()
+	int IterationBudget;
+
+	PathScheduler(NavMesh const & navmesh);
+
+	// Requests are dropped from the queue once the caller has released them
+	RequestPtr Submit(Vertex const & start, Vertex const & end);
+	void Update();
+
+	size_t QueueSize() const
+	{
+		return queue.size();
+	}
+
+	NavMesh const & GetNavMesh() const
+	{
+		return navmesh;
+	}
+
+private:
+	NavMesh const & navmesh;
+	std::unique_ptr<NavMesh::QueryContext> context;
+	dtQueryFilter filter;
+
+	std::deque<RequestPtr> queue;
+
+	void UpdateAsync();
+	bool Start(Request & request);
+	void Finalize(Request & request, dtStatus status);
+	void UpdatePartialPath(Request & request);
+};
+}
+
+#endif // PATHSCHEDULER_H
@@ -15,18 +15,28 @@
 
 #include <tuple>
 #include <vector>
+#include <deque>
+#include <map>
+#include <string>
 #include <stdexcept>
 #include <memory>
+#include <future>
 #include <string.h>
+#include <stdint.h>
+
+#include <boost/thread/tss.hpp>
+#include <boost/date_time/posix_time/posix_time_types.hpp>
 
 #include <OgreVector3.h>
 
 #include "../DebugDrawer.h"
+#include "BuildArena.h"
 
 namespace Pathfinding
 {
 typedef Ogre::Vector3 Vertex;
-typedef std::tuple<Vertex, Vertex, Vertex> Triangle;
+
+class QueryWorkers;
 
 class NavMesh
 {
@@ -48,19 +58,62 @@ public:
 
 	Vertex QueryExtent;
 
+	// Width of the navmesh tiles in cells, 0 to build a single tile.
+	// Tiles are built in parallel on BuildThreads threads, 0 to use
+	// one thread per core.
+	int TileSize;
+	int BuildThreads;
+
+	// Query object and scratch buffers, allocated once and reused by every
+	// query made through it. A context must only be used by one thread at a time.
+	class QueryContext
+	{
+		friend class NavMesh;
+		std::shared_ptr<dtNavMesh> navmesh;
+		std::shared_ptr<dtNavMeshQuery> navmeshquery;
+
+		QueryContext(std::shared_ptr<dtNavMesh> navmeshref, int maxnodes);
+
+	public:
+		std::vector<dtPolyRef> polys;
+		std::vector<float> straightpath;
+
+		dtNavMeshQuery & query()
+		{
+			return *navmeshquery;
+		}
+	};
+
 	class Path
 	{
 
 		friend class NavMesh;
+		friend class PathScheduler;
+		friend class GoalField;
+		friend class PathCorridor;
 		std::shared_ptr<dtNavMesh> navmesh;
 
 		std::vector<Vertex> vertices;
+		std::vector<dtPolyRef> polygons;
 
-		Path(std::shared_ptr<dtNavMesh> navmeshref,
+		Path(QueryContext & context,
 		     const float * start,
 		     const float * end,
 		     const float * extent,
 		     const dtQueryFilter & filter);
+
+		// Straight path along an already known polygon corridor
+		Path(QueryContext & context,
+		     const float * start,
+		     const float * end,
+		     const dtPolyRef * polys,
+		     int npolys);
+
+		void straighten(QueryContext & context,
+		                const float * start,
+		                const float * end,
+		                const dtPolyRef * polys,
+		                int npolys);
 		
 	public:
 		Path() {}
@@ -93,41 +146,157 @@ public:
 		{
 			return vertices.end();
 		}
+
+		// Polygons the path goes through
+		std::vector<dtPolyRef> const & polys() const
+		{
+			return polygons;
+		}
+
+		// First corner from corner on that position has not reached: a
+		// corner is reached within distance of it, or once position is
+		// past it along the segment leading to it. Heights are ignored.
+		size_t NextCorner(Vertex const & position, size_t corner, float distance) const;
+	};
+
+	struct BuildStats
+	{
+		int Tiles;
+		int Polys;
+		int Threads;
+		// Sum of the build times of every tile
+		boost::posix_time::time_duration TileTime;
+		boost::posix_time::time_duration Time;
+		// Recast allocations
+		BuildArena::Counters Memory;
 	};
 
+	typedef unsigned int ObstacleRef;
+
 private:
-	rcContext ctx;
+	// Intermediate Recast results of one tile, kept for debug drawing.
+	// The compact heightfield and its areas before any obstacle was marked
+	// are also used to rebuild the tile when obstacles change.
+	struct Tile
+	{
+		int x;
+		int y;
+		rcConfig cfg;
+		rcHeightfield * hf;
+		rcCompactHeightfield * chf;
+		rcContourSet * cset;
+		rcPolyMesh * mesh;
+		rcPolyMeshDetail * dmesh;
+		std::vector<unsigned char> areas;
+		unsigned char * navData;
+		int navDataSize;
+		dtTileRef ref;
+		bool dirty;
+		boost::posix_time::time_duration time;
+
+		Tile(int x, int y, rcConfig const & cfg);
+		~Tile();
+
+		// Replaces the contours and meshes by empty ones before a rebuild
+		void ResetMesh();
+
+	private:
+		Tile(Tile const &);
+		Tile & operator=(Tile const &);
+		void Free();
+	};
 
-	rcHeightfield * hf;
-	rcCompactHeightfield * chf;
-	rcContourSet * cset;
-	rcPolyMesh * mesh;
-	rcPolyMeshDetail * dmesh;
+	// Cylinders stand on their position, both are expanded by the agent
+	// radius when they are marked
+	struct Obstacle
+	{
+		bool cylinder;
+		float pos[3];
+		float radius;
+		float height;
+		float bmin[3];
+		float bmax[3];
+	};
+
+	std::vector<std::unique_ptr<Tile> > tiles;
 	std::shared_ptr<dtNavMesh> navmesh;
 
+	std::map<ObstacleRef, Obstacle> obstacles;
+	ObstacleRef lastObstacle;
+	std::deque<Tile *> dirtyTiles;
+
 	rcConfig cfg;
+	BuildStats stats;
 
 	float bmin[3];
 	float bmax[3];
 
-	unsigned char * navData;
-	int navDataSize;
+	mutable boost::thread_specific_ptr<QueryContext> queryContexts;
+	std::unique_ptr<QueryWorkers> workers;
 
-	static void toRecastVertex(Vertex const & v1, float * v2);
 	void updateAabb(Vertex const & v);
-
-	std::vector<std::pair<Triangle, int> > Triangles;
+	void buildTile(Tile & tile, std::vector<int> const & triangles) const;
+	void buildTileMesh(Tile & tile, rcContext & ctx) const;
+	void markObstacles(Tile & tile, rcContext & ctx) const;
+	bool overlaps(Tile const & tile, Obstacle const & obstacle) const;
+	void markDirty(Obstacle const & obstacle);
+	uint64_t parametersHash() const;
+
+	// Level geometry: 3 floats per vertex, and 3 vertex indices and an
+	// area per triangle
+	std::vector<float> Vertices;
+	std::vector<int> Triangles;
+	std::vector<unsigned char> Areas;
 	void Free();
 	void Alloc();
 
 public:
+	static void toRecastVertex(Vertex const & v1, float * v2);
+
 	void Reset();
 	NavMesh();
 	~NavMesh();
 
 	void AddTriangle(const Vertex & v1, const Vertex & v2, const Vertex & v3, const int area);
+	// Indexed triangles, 3 indices in vertices and one area per triangle
+	void AddMesh(std::vector<Vertex> const & vertices, std::vector<int> const & indices, std::vector<unsigned char> const & areas);
 	void Build();
-	Path Query(Vertex const & start, Vertex const & end) const
+
+	// Navmesh cache: Load() returns false if the file is missing, or was
+	// written with another key or other build parameters, and leaves the
+	// navmesh unchanged. The file is mapped in memory and stays open as
+	// long as the navmesh uses it.
+	bool Load(std::string const & filename, uint64_t key);
+	void Save(std::string const & filename, uint64_t key) const;
+
+	// Obstacles remove the walkable area they cover, the tiles they touch
+	// are rebuilt from their compact heightfield by Update(). A cylinder
+	// stands on position.
+	ObstacleRef AddCylinderObstacle(Vertex const & position, float radius, float height);
+	ObstacleRef AddBoxObstacle(Vertex const & bmin, Vertex const & bmax);
+	void RemoveObstacle(ObstacleRef ref);
+
+	// Rebuilds the tiles changed by obstacles until budget is spent, at
+	// least one per call. Returns the number of rebuilt tiles: polygon
+	// references into them are no longer valid.
+	int Update(boost::posix_time::time_duration budget);
+
+	size_t DirtyTiles() const
+	{
+		return dirtyTiles.size();
+	}
+
+	BuildStats const & GetBuildStats() const
+	{
+		return stats;
+	}
+
+	// Context owned by the calling thread, created on first use and
+	// recreated after the navmesh has been rebuilt
+	QueryContext & GetQueryContext() const;
+	std::unique_ptr<QueryContext> CreateQueryContext() const;
+
+	Path Query(Vertex const & start, Vertex const & end, QueryContext & context) const
 	{
 		float _start[3];
 		float _end[3];
@@ -138,9 +307,22 @@ public:
 		toRecastVertex(QueryExtent, _extent);
 		dtQueryFilter filter;
 
-		return Path(navmesh, _start, _end, _extent, filter);
+		return Path(context, _start, _end, _extent, filter);
 	}
 
+	Path Query(Vertex const & start, Vertex const & end) const
+	{
+		return Query(start, end, GetQueryContext());
+	}
+
+	// Runs the query on a worker thread, StartWorkers() must have been
+	// called. The navmesh must not be rebuilt while queries are pending.
+	std::future<Path> QueryAsync(Vertex const & start, Vertex const & end) const;
+
+	void StartWorkers(int count);
+	void StopWorkers();
+	int WorkerCount() const;
+
 	bool DrawHeightfield;
 	bool DrawCompactHeightfield;
 	bool DrawRawContours;
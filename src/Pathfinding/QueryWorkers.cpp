@@ -0,0 +1,67 @@
+#include "QueryWorkers.h"
+
+namespace Pathfinding
+{
+QueryWorkers::QueryWorkers(int count) : running(0), stopping(false)
+{
+	for(int i = 0; i < count; ++i)
+		threads.push_back(std::thread(&QueryWorkers::Run, this));
+}
+
+QueryWorkers::~QueryWorkers()
+{
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		stopping = true;
+	}
+
+	wakeup.notify_all();
+
+	for(size_t i = 0; i < threads.size(); ++i)
+		threads[i].join();
+}
+
+void QueryWorkers::Push(std::function<void()> task)
+{
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		tasks.push_back(task);
+	}
+
+	wakeup.notify_one();
+}
+
+void QueryWorkers::Wait()
+{
+	std::unique_lock<std::mutex> lock(mutex);
+
+	while (!tasks.empty() || running > 0)
+		idle.wait(lock);
+}
+
+void QueryWorkers::Run()
+{
+	std::unique_lock<std::mutex> lock(mutex);
+
+	while (true)
+	{
+		while (tasks.empty() && !stopping)
+			wakeup.wait(lock);
+
+		if (tasks.empty())
+			return;
+
+		std::function<void()> task = tasks.front();
+		tasks.pop_front();
+		++running;
+
+		lock.unlock();
+		task();
+		lock.lock();
+
+		--running;
+		if (tasks.empty() && running == 0)
+			idle.notify_all();
+	}
+}
+}
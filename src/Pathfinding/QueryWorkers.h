@@ -0,0 +1,49 @@
+// -*- c++ -*-
+
+#ifndef QUERYWORKERS_H
+#define QUERYWORKERS_H
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace Pathfinding
+{
+// Pool of threads running navmesh queries. Each thread uses its own
+// NavMesh::QueryContext, the dtNavMesh itself is shared read-only.
+// NavMesh::Build() also uses a temporary pool to build the tiles.
+class QueryWorkers
+{
+	std::vector<std::thread> threads;
+	std::deque<std::function<void()> > tasks;
+	std::mutex mutex;
+	std::condition_variable wakeup;
+	std::condition_variable idle;
+	int running;
+	bool stopping;
+
+	QueryWorkers(QueryWorkers const &);
+	QueryWorkers & operator=(QueryWorkers const &);
+
+	void Run();
+
+public:
+	QueryWorkers(int count);
+	~QueryWorkers();
+
+	void Push(std::function<void()> task);
+
+	// Blocks until every queued task has completed
+	void Wait();
+
+	int Size() const
+	{
+		return threads.size();
+	}
+};
+}
+
+#endif // QUERYWORKERS_H
@@ -3,6 +3,8 @@
 
 #include <OgreColourValue.h>
 
+#include <boost/foreach.hpp>
+
 namespace Pathfinding
 {
 void NavMesh::DebugDraw(DebugDrawer & dd)
@@ -20,7 +22,7 @@ void NavMesh::DebugDraw(DebugDrawer & dd)
 	if (DrawPolyMeshDetail) DebugDrawPolyMeshDetail(dd);
 }
 
-void NavMesh::DebugDrawHeightfield(DebugDrawer & dd)
+static void drawHeightfield(DebugDrawer & dd, const rcHeightfield * hf)
 {
 	if (!hf) return;
 
@@ -69,7 +71,7 @@ void NavMesh::DebugDrawHeightfield(DebugDrawer & dd)
 	}
 }
 
-void NavMesh::DebugDrawCompactHeightfield(DebugDrawer & dd)
+static void drawCompactHeightfield(DebugDrawer & dd, const rcCompactHeightfield * chf)
 {
 	if (!chf) return;
 
@@ -116,7 +118,7 @@ void NavMesh::DebugDrawCompactHeightfield(DebugDrawer & dd)
 	}
 }
 
-void NavMesh::DebugDrawRawContours(DebugDrawer & dd)
+static void drawRawContours(DebugDrawer & dd, const rcContourSet * cset)
 {
 	if (!cset) return;
 
@@ -147,7 +149,7 @@ void NavMesh::DebugDrawRawContours(DebugDrawer & dd)
 	}
 }
 
-void NavMesh::DebugDrawContours(DebugDrawer & dd)
+static void drawContours(DebugDrawer & dd, const rcContourSet * cset)
 {
 	if (!cset) return;
 
@@ -178,12 +180,12 @@ void NavMesh::DebugDrawContours(DebugDrawer & dd)
 	}
 }
 
-void NavMesh::DebugDrawPolyMesh(DebugDrawer & dd)
+static void drawPolyMesh(DebugDrawer & dd, const rcPolyMesh * mesh)
 {
 	if (!mesh) return;
 }
 
-void NavMesh::DebugDrawPolyMeshDetail(DebugDrawer & dd)
+static void drawPolyMeshDetail(DebugDrawer & dd, const rcPolyMeshDetail * dmesh)
 {
 	if (!dmesh) return;
 
@@ -221,4 +223,40 @@ void NavMesh::DebugDrawPolyMeshDetail(DebugDrawer & dd)
 	}
 }
 
+void NavMesh::DebugDrawHeightfield(DebugDrawer & dd)
+{
+	BOOST_FOREACH(auto const & tile, tiles)
+		drawHeightfield(dd, tile->hf);
+}
+
+void NavMesh::DebugDrawCompactHeightfield(DebugDrawer & dd)
+{
+	BOOST_FOREACH(auto const & tile, tiles)
+		drawCompactHeightfield(dd, tile->chf);
+}
+
+void NavMesh::DebugDrawRawContours(DebugDrawer & dd)
+{
+	BOOST_FOREACH(auto const & tile, tiles)
+		drawRawContours(dd, tile->cset);
+}
+
+void NavMesh::DebugDrawContours(DebugDrawer & dd)
+{
+	BOOST_FOREACH(auto const & tile, tiles)
+		drawContours(dd, tile->cset);
+}
+
+void NavMesh::DebugDrawPolyMesh(DebugDrawer & dd)
+{
+	BOOST_FOREACH(auto const & tile, tiles)
+		drawPolyMesh(dd, tile->mesh);
+}
+
+void NavMesh::DebugDrawPolyMeshDetail(DebugDrawer & dd)
+{
+	BOOST_FOREACH(auto const & tile, tiles)
+		drawPolyMeshDetail(dd, tile->dmesh);
+}
+
 }
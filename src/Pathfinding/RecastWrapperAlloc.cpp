@@ -1,13 +1,84 @@
 #include "Pathfinding.h"
+#include "QueryWorkers.h"
+#include "Detour/DetourAlloc.h"
 
 #define _USE_MATH_DEFINES
 #include <math.h>
 
 namespace Pathfinding
 {
-void NavMesh::Free()
+NavMesh::Tile::Tile(int _x, int _y, rcConfig const & _cfg) :
+	x(_x), y(_y),
+	cfg(_cfg),
+	hf(0), chf(0), cset(0), mesh(0), dmesh(0),
+	navData(0), navDataSize(0),
+	ref(0),
+	dirty(false)
 {
-	navmesh.reset();
+	try
+	{
+		hf = rcAllocHeightfield();
+
+		if (!hf) throw std::bad_alloc();
+
+		chf = rcAllocCompactHeightfield();
+
+		if (!chf) throw std::bad_alloc();
+
+		cset = rcAllocContourSet();
+
+		if (!cset) throw std::bad_alloc();
+
+		mesh = rcAllocPolyMesh();
+
+		if (!mesh) throw std::bad_alloc();
+
+		dmesh = rcAllocPolyMeshDetail();
+
+		if (!dmesh) throw std::bad_alloc();
+	}
+	catch (...)
+	{
+		Free();
+		throw;
+	}
+}
+
+NavMesh::Tile::~Tile()
+{
+	Free();
+}
+
+void NavMesh::Tile::ResetMesh()
+{
+	rcFreePolyMeshDetail(dmesh);
+	dmesh = 0;
+	rcFreePolyMesh(mesh);
+	mesh = 0;
+	rcFreeContourSet(cset);
+	cset = 0;
+
+	cset = rcAllocContourSet();
+
+	if (!cset) throw std::bad_alloc();
+
+	mesh = rcAllocPolyMesh();
+
+	if (!mesh) throw std::bad_alloc();
+
+	dmesh = rcAllocPolyMeshDetail();
+
+	if (!dmesh) throw std::bad_alloc();
+}
+
+void NavMesh::Tile::Free()
+{
+	// Owned by the dtNavMesh once the tile has been added
+	if (navData)
+	{
+		dtFree(navData);
+		navData = 0;
+	}
 
 	if (dmesh)
 	{
@@ -40,39 +111,18 @@ void NavMesh::Free()
 	}
 }
 
-void NavMesh::Alloc()
+void NavMesh::Free()
 {
-	try
-	{
-		hf = rcAllocHeightfield();
-
-		if (!hf) throw std::bad_alloc();
-
-		chf = rcAllocCompactHeightfield();
-
-		if (!chf) throw std::bad_alloc();
-
-		cset = rcAllocContourSet();
-
-		if (!cset) throw std::bad_alloc();
-
-		mesh = rcAllocPolyMesh();
-
-		if (!mesh) throw std::bad_alloc();
-
-		dmesh = rcAllocPolyMeshDetail();
-
-		if (!dmesh) throw std::bad_alloc();
+	navmesh.reset();
+	dirtyTiles.clear();
+	tiles.clear();
+}
 
-		navmesh = std::shared_ptr<dtNavMesh>(dtAllocNavMesh(), dtFreeNavMesh);
+void NavMesh::Alloc()
+{
+	navmesh = std::shared_ptr<dtNavMesh>(dtAllocNavMesh(), dtFreeNavMesh);
 
-		if (!navmesh) throw std::bad_alloc();
-	}
-	catch (...)
-	{
-		Free();
-		throw;
-	}
+	if (!navmesh) throw std::bad_alloc();
 }
 
 void NavMesh::Reset()
@@ -96,7 +146,9 @@ NavMesh::NavMesh() : CellSize(0.3),
 		DetailSampleDist(6),
 		DetailSampleMaxError(1),
 		QueryExtent(2, 4, 2),
-		hf(0), chf(0), cset(0), mesh(0), dmesh(0),
+		TileSize(0),
+		BuildThreads(0),
+		lastObstacle(0),
 		DrawHeightfield(false),
 		DrawCompactHeightfield(false),
 		DrawRawContours(false),
@@ -105,6 +157,9 @@ NavMesh::NavMesh() : CellSize(0.3),
 		DrawPolyMeshDetail(false)
 {
 	memset(&cfg, 0, sizeof(cfg));
+	stats.Tiles = 0;
+	stats.Polys = 0;
+	stats.Threads = 0;
 	bmin[0] = FLT_MAX;
 	bmin[1] = FLT_MAX;
 	bmin[2] = FLT_MAX;
@@ -115,6 +170,7 @@ NavMesh::NavMesh() : CellSize(0.3),
 
 NavMesh::~NavMesh()
 {
+	StopWorkers();
 	Free();
 }
 }
@@ -1,5 +1,11 @@
 #include "Pathfinding.h"
+#include "QueryWorkers.h"
+#include "Recast/RecastAlloc.h"
 #include <boost/foreach.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
+
+#include <algorithm>
+#include <thread>
 
 namespace Pathfinding
 {
@@ -7,11 +13,37 @@ namespace Pathfinding
     {
 	assert(area >= 0);
 	assert(area <= UCHAR_MAX);
-	std::pair<Triangle, int> tri(Triangle(v1, v2, v3), area);
-	Triangles.push_back(tri);
-	updateAabb(v1);
-	updateAabb(v2);
-	updateAabb(v3);
+	const int first = Vertices.size() / 3;
+	Vertex const * v[3] = { &v1, &v2, &v3 };
+	for(int i = 0; i < 3; ++i)
+	{
+	    float rv[3]; toRecastVertex(*v[i], rv);
+	    Vertices.insert(Vertices.end(), rv, rv + 3);
+	    Triangles.push_back(first + i);
+	    updateAabb(*v[i]);
+	}
+	Areas.push_back(area);
+    }
+
+    void NavMesh::AddMesh(std::vector<Vertex> const & vertices, std::vector<int> const & indices, std::vector<unsigned char> const & areas)
+    {
+	assert(indices.size() == areas.size() * 3);
+	const int first = Vertices.size() / 3;
+
+	BOOST_FOREACH(Vertex const & v, vertices)
+	{
+	    float rv[3]; toRecastVertex(v, rv);
+	    Vertices.insert(Vertices.end(), rv, rv + 3);
+	    updateAabb(v);
+	}
+
+	BOOST_FOREACH(int i, indices)
+	{
+	    assert(i >= 0 && i < (int)vertices.size());
+	    Triangles.push_back(first + i);
+	}
+
+	Areas.insert(Areas.end(), areas.begin(), areas.end());
     }
 
     void NavMesh::Build()
@@ -43,85 +75,295 @@ namespace Pathfinding
 	if (cfg.maxVertsPerPoly > DT_VERTS_PER_POLYGON)
 	    throw std::range_error("maxVertsPerPoly > 6");
 
+	// Worker threads must not query the navmesh while it is replaced
+	if (workers)
+	    workers->Wait();
+
 	Reset();
 
-	cfg.width  = (cfg.bmax[0] - cfg.bmin[0]) / cfg.cs + 1;
-	cfg.height = (cfg.bmax[2] - cfg.bmin[2]) / cfg.cs + 1;
-	    
-	if (!rcCreateHeightfield(&ctx, *hf, cfg.width, cfg.height, cfg.bmin, cfg.bmax, cfg.cs, cfg.ch))
+	boost::posix_time::ptime t1 = boost::posix_time::microsec_clock::universal_time();
+
+	// Temporary Recast allocations are served by the arenas of the build
+	// threads until the end of the build
+	BuildArena::Install arenaallocator;
+
+	std::vector<std::vector<int> > tiletriangles;
+
+	if (TileSize <= 0)
+	{
+	    cfg.width  = (cfg.bmax[0] - cfg.bmin[0]) / cfg.cs + 1;
+	    cfg.height = (cfg.bmax[2] - cfg.bmin[2]) / cfg.cs + 1;
+
+	    tiles.push_back(std::unique_ptr<Tile>(new Tile(0, 0, cfg)));
+	    tiletriangles.push_back(std::vector<int>(Areas.size()));
+	    for(size_t i = 0; i < Areas.size(); ++i)
+		tiletriangles[0][i] = i;
+	}
+	else
+	{
+	    cfg.tileSize = TileSize;
+	    cfg.borderSize = cfg.walkableRadius + 3;
+	    cfg.width = cfg.tileSize + cfg.borderSize * 2;
+	    cfg.height = cfg.tileSize + cfg.borderSize * 2;
+
+	    int gw = 0, gh = 0;
+	    rcCalcGridSize(bmin, bmax, cfg.cs, &gw, &gh);
+	    const int tw = (gw + cfg.tileSize - 1) / cfg.tileSize;
+	    const int th = (gh + cfg.tileSize - 1) / cfg.tileSize;
+	    const float tcs = cfg.tileSize * cfg.cs;
+	    const float border = cfg.borderSize * cfg.cs;
+
+	    // Same split of the 32 bits references as RecastDemo
+	    int tilebits = 0;
+	    while((1 << tilebits) < tw * th)
+		++tilebits;
+	    tilebits = std::min(tilebits, 14);
+
+	    dtNavMeshParams params;
+	    rcVcopy(params.orig, bmin);
+	    params.tileWidth = tcs;
+	    params.tileHeight = tcs;
+	    params.maxTiles = 1 << tilebits;
+	    params.maxPolys = 1 << (22 - tilebits);
+
+	    if (dtStatusFailed(navmesh->init(&params)))
+		throw std::bad_alloc();
+
+	    for(int y = 0; y < th; ++y)
+	    {
+		for(int x = 0; x < tw; ++x)
+		{
+		    rcConfig tilecfg = cfg;
+		    tilecfg.bmin[0] = bmin[0] + x * tcs - border;
+		    tilecfg.bmin[2] = bmin[2] + y * tcs - border;
+		    tilecfg.bmax[0] = bmin[0] + (x + 1) * tcs + border;
+		    tilecfg.bmax[2] = bmin[2] + (y + 1) * tcs + border;
+
+		    tiles.push_back(std::unique_ptr<Tile>(new Tile(x, y, tilecfg)));
+		}
+	    }
+
+	    // Sort the triangles by tile, including the border of the tiles
+	    tiletriangles.resize(tiles.size());
+	    for(size_t i = 0; i < Areas.size(); ++i)
+	    {
+		const float * v1 = &Vertices[Triangles[i * 3] * 3];
+		const float * v2 = &Vertices[Triangles[i * 3 + 1] * 3];
+		const float * v3 = &Vertices[Triangles[i * 3 + 2] * 3];
+		float tmin[2] = {
+		    std::min(std::min(v1[0], v2[0]), v3[0]),
+		    std::min(std::min(v1[2], v2[2]), v3[2]) };
+		float tmax[2] = {
+		    std::max(std::max(v1[0], v2[0]), v3[0]),
+		    std::max(std::max(v1[2], v2[2]), v3[2]) };
+
+		int x0 = std::max(0, (int)floorf((tmin[0] - border - bmin[0]) / tcs));
+		int y0 = std::max(0, (int)floorf((tmin[1] - border - bmin[2]) / tcs));
+		int x1 = std::min(tw - 1, (int)floorf((tmax[0] + border - bmin[0]) / tcs));
+		int y1 = std::min(th - 1, (int)floorf((tmax[1] + border - bmin[2]) / tcs));
+
+		for(int y = y0; y <= y1; ++y)
+		    for(int x = x0; x <= x1; ++x)
+			tiletriangles[y * tw + x].push_back(i);
+	    }
+	}
+
+	stats.Threads = BuildThreads > 0 ? BuildThreads : std::max(1, (int)std::thread::hardware_concurrency());
+	stats.Threads = std::min(stats.Threads, (int)tiles.size());
+
+	// Exceptions thrown while building a tile are rethrown by the futures
+	std::vector<std::future<void> > results;
+	BuildArena::Pool arenas(stats.Threads);
+	{
+	    QueryWorkers pool(stats.Threads);
+
+	    for(size_t i = 0; i < tiles.size(); ++i)
+	    {
+		Tile & tile = *tiles[i];
+		std::vector<int> const & triangles = tiletriangles[i];
+
+		std::shared_ptr<std::packaged_task<void()> > task(new std::packaged_task<void()>([this, &tile, &triangles, &arenas]()
+		{
+		    BuildArena::Pool::Lease lease(arenas);
+		    BuildArena::Scope scope(*lease.arena);
+		    buildTile(tile, triangles);
+		}));
+
+		results.push_back(task->get_future());
+		pool.Push([task]() { (*task)(); });
+	    }
+
+	    pool.Wait();
+	}
+
+	BOOST_FOREACH(auto & result, results)
+	    result.get();
+
+	stats.Memory = arenas.GetCounters();
+
+	stats.Tiles = 0;
+	stats.Polys = 0;
+	stats.TileTime = boost::posix_time::time_duration();
+
+	// dtNavMesh is not thread safe, tiles are added from this thread only
+	std::vector<std::unique_ptr<Tile> > built;
+	BOOST_FOREACH(auto & tile, tiles)
+	{
+	    stats.TileTime += tile->time;
+
+	    // Tiles hidden by obstacles are kept, they come back with Update()
+	    if (!tile->navData)
+	    {
+		if (std::count(tile->areas.begin(), tile->areas.end(), RC_NULL_AREA) < (int)tile->areas.size())
+		    built.push_back(std::move(tile));
+		continue;
+	    }
+
+	    dtStatus status;
+	    if (TileSize <= 0)
+		status = navmesh->init(tile->navData, tile->navDataSize, DT_TILE_FREE_DATA);
+	    else
+		status = navmesh->addTile(tile->navData, tile->navDataSize, DT_TILE_FREE_DATA, 0, &tile->ref);
+
+	    if (dtStatusFailed(status))
+		throw std::bad_alloc();
+
+	    if (TileSize <= 0)
+		tile->ref = navmesh->getTileRefAt(0, 0, 0);
+
+	    tile->navData = 0;
+	    stats.Tiles++;
+	    stats.Polys += tile->mesh->npolys;
+	    built.push_back(std::move(tile));
+	}
+	tiles.swap(built);
+
+	// Keep a valid navmesh even if nothing is walkable
+	if (TileSize <= 0 && stats.Tiles == 0)
+	{
+	    dtNavMeshParams params;
+	    rcVcopy(params.orig, bmin);
+	    params.tileWidth = bmax[0] - bmin[0];
+	    params.tileHeight = bmax[2] - bmin[2];
+	    params.maxTiles = 1;
+	    params.maxPolys = 1;
+
+	    if (dtStatusFailed(navmesh->init(&params)))
+		throw std::bad_alloc();
+	}
+
+	stats.Time = boost::posix_time::microsec_clock::universal_time() - t1;
+    }
+
+    void NavMesh::buildTile(Tile & tile, std::vector<int> const & triangles) const
+    {
+	rcConfig const & tilecfg = tile.cfg;
+	boost::posix_time::ptime t1 = boost::posix_time::microsec_clock::universal_time();
+
+	// rcContext is not thread safe
+	rcContext ctx(false);
+
+	BuildArena::SetStage(BuildArena::Heightfield);
+	if (!rcCreateHeightfield(&ctx, *tile.hf, tilecfg.width, tilecfg.height, tilecfg.bmin, tilecfg.bmax, tilecfg.cs, tilecfg.ch))
 	    throw std::bad_alloc();
-	    
-	//for(std::pair<Triangle, int> const & tri : Triangles)
-	BOOST_FOREACH(auto const & tri, Triangles)
+
+	BOOST_FOREACH(int i, triangles)
 	{
 	    const int flagMergeThreshold = 0;
-		
-	    float v1[3]; toRecastVertex(std::get<0>(tri.first), v1);
-	    float v2[3]; toRecastVertex(std::get<1>(tri.first), v2);
-	    float v3[3]; toRecastVertex(std::get<2>(tri.first), v3);
-		
-	    rcRasterizeTriangle(&ctx, v1, v2, v3, tri.second, *hf, flagMergeThreshold);
+	    const float * v1 = &Vertices[Triangles[i * 3] * 3];
+	    const float * v2 = &Vertices[Triangles[i * 3 + 1] * 3];
+	    const float * v3 = &Vertices[Triangles[i * 3 + 2] * 3];
+
+	    rcRasterizeTriangle(&ctx, v1, v2, v3, Areas[i], *tile.hf, flagMergeThreshold);
 	}
-	    
-	rcFilterLowHangingWalkableObstacles(&ctx, cfg.walkableClimb, *hf);
-	rcFilterLedgeSpans(&ctx, cfg.walkableHeight, cfg.walkableClimb, *hf);
-	rcFilterWalkableLowHeightSpans(&ctx, cfg.walkableHeight, *hf);
 
-	if (!rcBuildCompactHeightfield(&ctx, cfg.walkableHeight, cfg.walkableClimb, *hf, *chf))
+	rcFilterLowHangingWalkableObstacles(&ctx, tilecfg.walkableClimb, *tile.hf);
+	rcFilterLedgeSpans(&ctx, tilecfg.walkableHeight, tilecfg.walkableClimb, *tile.hf);
+	rcFilterWalkableLowHeightSpans(&ctx, tilecfg.walkableHeight, *tile.hf);
+
+	BuildArena::SetStage(BuildArena::CompactHeightfield);
+	if (!rcBuildCompactHeightfield(&ctx, tilecfg.walkableHeight, tilecfg.walkableClimb, *tile.hf, *tile.chf))
 	    throw std::bad_alloc();
 
-	if (!rcErodeWalkableArea(&ctx, cfg.walkableRadius, *chf))
+	if (!rcErodeWalkableArea(&ctx, tilecfg.walkableRadius, *tile.chf))
 	    throw std::bad_alloc();
 
-	if (!rcBuildDistanceField(&ctx, *chf))
+	tile.areas.assign(tile.chf->areas, tile.chf->areas + tile.chf->spanCount);
+	markObstacles(tile, ctx);
+
+	buildTileMesh(tile, ctx);
+
+	tile.time = boost::posix_time::microsec_clock::universal_time() - t1;
+    }
+
+    // Builds the navmesh data of a tile from its compact heightfield
+    void NavMesh::buildTileMesh(Tile & tile, rcContext & ctx) const
+    {
+	rcConfig const & tilecfg = tile.cfg;
+
+	BuildArena::SetStage(BuildArena::Regions);
+	if (!rcBuildDistanceField(&ctx, *tile.chf))
 	    throw std::bad_alloc();
 
-	if (!rcBuildRegions(&ctx, *chf, 0 /* border size */, cfg.minRegionArea, cfg.mergeRegionArea))
+	if (!rcBuildRegions(&ctx, *tile.chf, tilecfg.borderSize, tilecfg.minRegionArea, tilecfg.mergeRegionArea))
 	    throw std::bad_alloc();
 
-	if (!rcBuildContours(&ctx, *chf, cfg.maxSimplificationError, cfg.maxEdgeLen, *cset))
+	// The distance field is only used by the regions, and Recast allocates
+	// it as temporary memory: it must not outlive the arena
+	rcFree(tile.chf->dist);
+	tile.chf->dist = 0;
+
+	BuildArena::SetStage(BuildArena::Contours);
+	if (!rcBuildContours(&ctx, *tile.chf, tilecfg.maxSimplificationError, tilecfg.maxEdgeLen, *tile.cset))
 	    throw std::bad_alloc();
 
-	if (!rcBuildPolyMesh(&ctx, *cset, cfg.maxVertsPerPoly, *mesh))
+	BuildArena::SetStage(BuildArena::PolyMesh);
+	if (!rcBuildPolyMesh(&ctx, *tile.cset, tilecfg.maxVertsPerPoly, *tile.mesh))
 	    throw std::bad_alloc();
 	
-	if (!rcBuildPolyMeshDetail(&ctx, *mesh, *chf, cfg.detailSampleDist, cfg.detailSampleMaxError, *dmesh))
+	BuildArena::SetStage(BuildArena::DetailMesh);
+	if (!rcBuildPolyMeshDetail(&ctx, *tile.mesh, *tile.chf, tilecfg.detailSampleDist, tilecfg.detailSampleMaxError, *tile.dmesh))
 	    throw std::bad_alloc();
+
+	// Nothing walkable in this tile
+	if (tile.mesh->nverts == 0 || tile.mesh->npolys == 0)
+	    return;
 	
 	// TODO: changer les flags cf Sample_SoloMesh.cpp:594
-	for(int i = 0; i < mesh->npolys; ++i)
+	for(int i = 0; i < tile.mesh->npolys; ++i)
 	{
-		mesh->flags[i] = 1;
+		tile.mesh->flags[i] = 1;
 	}
 	
 	dtNavMeshCreateParams params;
 	memset(&params, 0, sizeof(params));
 	
-	params.verts = mesh->verts;
-	params.vertCount = mesh->nverts;
-	params.polys = mesh->polys;
-	params.polyAreas = mesh->areas;
-	params.polyFlags = mesh->flags;
-	params.polyCount = mesh->npolys;
-	params.nvp = mesh->nvp;
+	params.verts = tile.mesh->verts;
+	params.vertCount = tile.mesh->nverts;
+	params.polys = tile.mesh->polys;
+	params.polyAreas = tile.mesh->areas;
+	params.polyFlags = tile.mesh->flags;
+	params.polyCount = tile.mesh->npolys;
+	params.nvp = tile.mesh->nvp;
 	
-	params.detailMeshes = dmesh->meshes;
-	params.detailVerts = dmesh->verts;
-	params.detailVertsCount = dmesh->nverts;
-	params.detailTris = dmesh->tris;
-	params.detailTriCount = dmesh->ntris;
-
-	params.walkableHeight = cfg.walkableHeight;
-	params.walkableClimb = cfg.walkableClimb;
-	rcVcopy(params.bmin, mesh->bmin);
-	rcVcopy(params.bmax, mesh->bmax);
-	params.cs = cfg.cs;
-	params.ch = cfg.ch;
+	params.detailMeshes = tile.dmesh->meshes;
+	params.detailVerts = tile.dmesh->verts;
+	params.detailVertsCount = tile.dmesh->nverts;
+	params.detailTris = tile.dmesh->tris;
+	params.detailTriCount = tile.dmesh->ntris;
+
+	params.walkableHeight = tilecfg.walkableHeight;
+	params.walkableRadius = tilecfg.walkableRadius;
+	params.walkableClimb = tilecfg.walkableClimb;
+	params.tileX = tile.x;
+	params.tileY = tile.y;
+	rcVcopy(params.bmin, tile.mesh->bmin);
+	rcVcopy(params.bmax, tile.mesh->bmax);
+	params.cs = tilecfg.cs;
+	params.ch = tilecfg.ch;
 	params.buildBvTree = true;
 
-	if (!dtCreateNavMeshData(&params, &navData, &navDataSize))
+	if (!dtCreateNavMeshData(&params, &tile.navData, &tile.navDataSize))
 	    throw std::bad_alloc();
-	    
-	navmesh->init(navData, navDataSize, DT_TILE_FREE_DATA);
     }
 }
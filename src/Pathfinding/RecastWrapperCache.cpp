@@ -0,0 +1,301 @@
+#include "Pathfinding.h"
+#include "QueryWorkers.h"
+#include "Recast/RecastAlloc.h"
+#include "../ContentHash.h"
+
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
+#include <boost/foreach.hpp>
+
+#include <algorithm>
+#include <fstream>
+#include <cstdio>
+
+namespace Pathfinding
+{
+// Cache file layout: CacheHeader, then for each tile a CacheTile followed
+// by the tile data and by the cells, spans and areas of its compact
+// heightfield, padded so that every block starts on 16 bytes
+static const char cachemagic[4] = { 'P', 'M', 'D', 'N' };
+static const int cacheversion = 2;
+static const size_t cachealign = 16;
+
+struct CacheHeader
+{
+	char magic[4];
+	int version;
+	uint64_t key;
+	uint64_t parameters;
+	dtNavMeshParams params;
+	int ntiles;
+};
+
+struct CacheTile
+{
+	int x;
+	int y;
+	rcConfig cfg;
+	// 0 if obstacles hid the whole tile
+	int size;
+	int width;
+	int height;
+	int spanCount;
+	int walkableHeight;
+	int walkableClimb;
+	int borderSize;
+	float bmin[3];
+	float bmax[3];
+	float cs;
+	float ch;
+};
+
+// Sizes of the blocks following a CacheTile
+static size_t cellsSize(CacheTile const & tile)
+{
+	return tile.width * tile.height * sizeof(rcCompactCell);
+}
+
+static size_t spansSize(CacheTile const & tile)
+{
+	return tile.spanCount * sizeof(rcCompactSpan);
+}
+
+static size_t areasSize(CacheTile const & tile)
+{
+	return tile.spanCount;
+}
+
+static size_t align(size_t offset)
+{
+	return (offset + cachealign - 1) & ~(cachealign - 1);
+}
+
+uint64_t NavMesh::parametersHash() const
+{
+	ContentHash hash;
+	hash.AddValue(CellSize);
+	hash.AddValue(CellHeight);
+	hash.AddValue(AgentMaxSlope);
+	hash.AddValue(AgentHeight);
+	hash.AddValue(AgentMaxClimb);
+	hash.AddValue(AgentRadius);
+	hash.AddValue(EdgeMaxLen);
+	hash.AddValue(EdgeMaxError);
+	hash.AddValue(RegionMinSize);
+	hash.AddValue(RegionMergeSize);
+	hash.AddValue(VertsPerPoly);
+	hash.AddValue(DetailSampleDist);
+	hash.AddValue(DetailSampleMaxError);
+	hash.AddValue(TileSize);
+	return hash.Value();
+}
+
+bool NavMesh::Load(std::string const & filename, uint64_t key)
+{
+	using namespace boost::interprocess;
+
+	boost::posix_time::ptime t1 = boost::posix_time::microsec_clock::universal_time();
+
+	// dtNavMesh::addTile() writes to the tile data, the mapping is private
+	// so that only the modified pages are copied
+	std::shared_ptr<mapped_region> region;
+	try
+	{
+		file_mapping file(filename.c_str(), read_only);
+		region = std::make_shared<mapped_region>(file, copy_on_write);
+	}
+	catch(interprocess_exception &)
+	{
+		return false;
+	}
+
+	unsigned char * data = (unsigned char *)region->get_address();
+	size_t size = region->get_size();
+
+	CacheHeader header;
+	if (size < sizeof(header))
+		return false;
+
+	memcpy(&header, data, sizeof(header));
+	if (memcmp(header.magic, cachemagic, sizeof(cachemagic)) ||
+	    header.version != cacheversion ||
+	    header.key != key ||
+	    header.parameters != parametersHash())
+		return false;
+
+	// Check the whole file before touching the current navmesh
+	std::vector<std::pair<CacheTile, unsigned char *> > tiledata;
+	size_t offset = align(sizeof(header));
+	for(int i = 0; i < header.ntiles; ++i)
+	{
+		CacheTile tile;
+		if (offset + sizeof(tile) > size)
+			return false;
+
+		memcpy(&tile, data + offset, sizeof(tile));
+		offset = align(offset + sizeof(tile));
+
+		if (tile.size < 0 || tile.width <= 0 || tile.height <= 0 || tile.spanCount < 0)
+			return false;
+
+		tiledata.push_back(std::make_pair(tile, data + offset));
+
+		size_t blocks[] = { (size_t)tile.size, cellsSize(tile), spansSize(tile), areasSize(tile) };
+		BOOST_FOREACH(size_t block, blocks)
+			offset = align(offset + block);
+
+		if (offset > size)
+			return false;
+	}
+
+	if (workers)
+		workers->Wait();
+
+	Reset();
+
+	// The tiles point into the mapping, which is released with the navmesh
+	navmesh = std::shared_ptr<dtNavMesh>(dtAllocNavMesh(), [region](dtNavMesh * mesh) { dtFreeNavMesh(mesh); });
+	if (!navmesh)
+		throw std::bad_alloc();
+
+	if (dtStatusFailed(navmesh->init(&header.params)))
+	{
+		Reset();
+		return false;
+	}
+
+	stats.Tiles = 0;
+	stats.Polys = 0;
+	stats.Threads = 0;
+	stats.TileTime = boost::posix_time::time_duration();
+	stats.Memory = BuildArena::Counters();
+
+	for(size_t i = 0; i < tiledata.size(); ++i)
+	{
+		CacheTile const & cached = tiledata[i].first;
+		unsigned char * tiledatabegin = tiledata[i].second;
+
+		tiles.push_back(std::unique_ptr<Tile>(new Tile(cached.x, cached.y, cached.cfg)));
+		Tile & tile = *tiles.back();
+
+		// The compact heightfield is copied: rebuilding the tile reallocates
+		// some of its arrays with rcAlloc
+		rcCompactHeightfield & chf = *tile.chf;
+		chf.width = cached.width;
+		chf.height = cached.height;
+		chf.spanCount = cached.spanCount;
+		chf.walkableHeight = cached.walkableHeight;
+		chf.walkableClimb = cached.walkableClimb;
+		chf.borderSize = cached.borderSize;
+		rcVcopy(chf.bmin, cached.bmin);
+		rcVcopy(chf.bmax, cached.bmax);
+		chf.cs = cached.cs;
+		chf.ch = cached.ch;
+
+		chf.cells = (rcCompactCell *)rcAlloc(cellsSize(cached), RC_ALLOC_PERM);
+		chf.spans = (rcCompactSpan *)rcAlloc(std::max<size_t>(spansSize(cached), 1), RC_ALLOC_PERM);
+		chf.areas = (unsigned char *)rcAlloc(std::max<size_t>(areasSize(cached), 1), RC_ALLOC_PERM);
+		if (!chf.cells || !chf.spans || !chf.areas)
+			throw std::bad_alloc();
+
+		size_t tileoffset = align(cached.size);
+		memcpy(chf.cells, tiledatabegin + tileoffset, cellsSize(cached));
+		tileoffset = align(tileoffset + cellsSize(cached));
+		memcpy(chf.spans, tiledatabegin + tileoffset, spansSize(cached));
+		tileoffset = align(tileoffset + spansSize(cached));
+		tile.areas.assign(tiledatabegin + tileoffset, tiledatabegin + tileoffset + areasSize(cached));
+		std::copy(tile.areas.begin(), tile.areas.end(), chf.areas);
+
+		if (cached.size == 0)
+			continue;
+
+		if (dtStatusFailed(navmesh->addTile(tiledatabegin, cached.size, 0, 0, &tile.ref)))
+		{
+			Reset();
+			return false;
+		}
+
+		stats.Tiles++;
+		stats.Polys += ((dtMeshHeader *)tiledatabegin)->polyCount;
+	}
+
+	// Obstacles added before loading
+	for(auto it = obstacles.begin(); it != obstacles.end(); ++it)
+		markDirty(it->second);
+
+	stats.Time = boost::posix_time::microsec_clock::universal_time() - t1;
+	return true;
+}
+
+void NavMesh::Save(std::string const & filename, uint64_t key) const
+{
+	if (!obstacles.empty())
+		throw std::logic_error("Pathfinding::NavMesh::Save: the navmesh must be saved without obstacles");
+
+	const dtNavMesh & mesh = *navmesh;
+
+	CacheHeader header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, cachemagic, sizeof(cachemagic));
+	header.version = cacheversion;
+	header.key = key;
+	header.parameters = parametersHash();
+	header.params = *mesh.getParams();
+	header.ntiles = tiles.size();
+
+	// Write to a temporary file so that a partial file is never loaded
+	const std::string tmpname = filename + ".tmp";
+	std::ofstream out(tmpname.c_str(), std::ios::binary | std::ios::trunc);
+	if (!out)
+		throw std::runtime_error("Cannot write navmesh cache " + tmpname);
+
+	const char padding[cachealign] = { 0 };
+	size_t offset = 0;
+	auto write = [&](const void * data, size_t size)
+	{
+		out.write((const char *)data, size);
+		out.write(padding, align(offset + size) - offset - size);
+		offset = align(offset + size);
+	};
+
+	write(&header, sizeof(header));
+
+	BOOST_FOREACH(auto const & tile, tiles)
+	{
+		const dtMeshTile * meshtile = tile->ref ? mesh.getTileByRef(tile->ref) : 0;
+		rcCompactHeightfield const & chf = *tile->chf;
+
+		CacheTile tileheader;
+		memset(&tileheader, 0, sizeof(tileheader));
+		tileheader.x = tile->x;
+		tileheader.y = tile->y;
+		tileheader.cfg = tile->cfg;
+		tileheader.size = meshtile ? meshtile->dataSize : 0;
+		tileheader.width = chf.width;
+		tileheader.height = chf.height;
+		tileheader.spanCount = chf.spanCount;
+		tileheader.walkableHeight = chf.walkableHeight;
+		tileheader.walkableClimb = chf.walkableClimb;
+		tileheader.borderSize = chf.borderSize;
+		rcVcopy(tileheader.bmin, chf.bmin);
+		rcVcopy(tileheader.bmax, chf.bmax);
+		tileheader.cs = chf.cs;
+		tileheader.ch = chf.ch;
+
+		write(&tileheader, sizeof(tileheader));
+		write(meshtile ? meshtile->data : 0, tileheader.size);
+		write(chf.cells, cellsSize(tileheader));
+		write(chf.spans, spansSize(tileheader));
+		write(tile->areas.empty() ? 0 : &tile->areas[0], areasSize(tileheader));
+	}
+
+	out.close();
+	if (!out)
+		throw std::runtime_error("Cannot write navmesh cache " + tmpname);
+
+	std::remove(filename.c_str());
+	if (std::rename(tmpname.c_str(), filename.c_str()))
+		throw std::runtime_error("Cannot write navmesh cache " + filename);
+}
+}
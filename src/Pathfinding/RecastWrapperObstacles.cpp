@@ -0,0 +1,163 @@
+#include "Pathfinding.h"
+#include "QueryWorkers.h"
+#include <boost/foreach.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
+
+#include <algorithm>
+
+namespace Pathfinding
+{
+bool NavMesh::overlaps(Tile const & tile, Obstacle const & obstacle) const
+{
+	// The tile bounds include its border, where obstacles change the
+	// regions and contours of the tile too
+	const float r = tile.cfg.walkableRadius * tile.cfg.cs;
+
+	return obstacle.bmin[0] - r <= tile.cfg.bmax[0] && obstacle.bmax[0] + r >= tile.cfg.bmin[0] &&
+	       obstacle.bmin[2] - r <= tile.cfg.bmax[2] && obstacle.bmax[2] + r >= tile.cfg.bmin[2];
+}
+
+// Restores the areas of the tile as they were built, then removes the
+// area under the obstacles. The compact heightfield is already eroded by
+// the agent radius, the obstacles are expanded by the same amount, and
+// down by the climb height so that objects resting on the floor mark it.
+void NavMesh::markObstacles(Tile & tile, rcContext & ctx) const
+{
+	std::copy(tile.areas.begin(), tile.areas.end(), tile.chf->areas);
+
+	const float r = tile.cfg.walkableRadius * tile.cfg.cs;
+	const float climb = tile.cfg.walkableClimb * tile.cfg.ch;
+
+	for(auto it = obstacles.begin(); it != obstacles.end(); ++it)
+	{
+		Obstacle const & obstacle = it->second;
+		if (!overlaps(tile, obstacle))
+			continue;
+
+		if (obstacle.cylinder)
+		{
+			float pos[3] = { obstacle.pos[0], obstacle.pos[1] - climb, obstacle.pos[2] };
+			rcMarkCylinderArea(&ctx, pos, obstacle.radius + r, obstacle.height + climb, RC_NULL_AREA, *tile.chf);
+		}
+		else
+		{
+			float bmin[3] = { obstacle.bmin[0] - r, obstacle.bmin[1] - climb, obstacle.bmin[2] - r };
+			float bmax[3] = { obstacle.bmax[0] + r, obstacle.bmax[1], obstacle.bmax[2] + r };
+			rcMarkBoxArea(&ctx, bmin, bmax, RC_NULL_AREA, *tile.chf);
+		}
+	}
+}
+
+void NavMesh::markDirty(Obstacle const & obstacle)
+{
+	BOOST_FOREACH(auto & tile, tiles)
+	{
+		if (!tile->dirty && overlaps(*tile, obstacle))
+		{
+			tile->dirty = true;
+			dirtyTiles.push_back(tile.get());
+		}
+	}
+}
+
+NavMesh::ObstacleRef NavMesh::AddCylinderObstacle(Vertex const & position, float radius, float height)
+{
+	Obstacle obstacle;
+	obstacle.cylinder = true;
+	toRecastVertex(position, obstacle.pos);
+	obstacle.radius = radius;
+	obstacle.height = height;
+	toRecastVertex(position - Vertex(radius, 0, radius), obstacle.bmin);
+	toRecastVertex(position + Vertex(radius, height, radius), obstacle.bmax);
+
+	ObstacleRef ref = ++lastObstacle;
+	obstacles[ref] = obstacle;
+	markDirty(obstacle);
+
+	return ref;
+}
+
+NavMesh::ObstacleRef NavMesh::AddBoxObstacle(Vertex const & bmin, Vertex const & bmax)
+{
+	Obstacle obstacle;
+	obstacle.cylinder = false;
+	toRecastVertex((bmin + bmax) / 2, obstacle.pos);
+	obstacle.radius = 0;
+	obstacle.height = bmax.y - bmin.y;
+	toRecastVertex(bmin, obstacle.bmin);
+	toRecastVertex(bmax, obstacle.bmax);
+
+	ObstacleRef ref = ++lastObstacle;
+	obstacles[ref] = obstacle;
+	markDirty(obstacle);
+
+	return ref;
+}
+
+void NavMesh::RemoveObstacle(ObstacleRef ref)
+{
+	auto it = obstacles.find(ref);
+	if (it == obstacles.end())
+		return;
+
+	Obstacle obstacle = it->second;
+	obstacles.erase(it);
+	markDirty(obstacle);
+}
+
+int NavMesh::Update(boost::posix_time::time_duration budget)
+{
+	if (dirtyTiles.empty())
+		return 0;
+
+	boost::posix_time::ptime t1 = boost::posix_time::microsec_clock::universal_time();
+
+	// rcContext is not thread safe
+	rcContext ctx(false);
+
+	BuildArena::Install arenaallocator;
+	BuildArena arena;
+
+	// The tiles are only rebuilt from their compact heightfield, the
+	// navmesh is not used until they are swapped below
+	std::vector<Tile *> rebuilt;
+	do
+	{
+		Tile & tile = *dirtyTiles.front();
+		dirtyTiles.pop_front();
+		tile.dirty = false;
+
+		BuildArena::Scope scope(arena);
+		tile.ResetMesh();
+		markObstacles(tile, ctx);
+		buildTileMesh(tile, ctx);
+		rebuilt.push_back(&tile);
+	}
+	while(!dirtyTiles.empty() && boost::posix_time::microsec_clock::universal_time() - t1 < budget);
+
+	// Worker threads must not query the navmesh while tiles are replaced
+	if (workers)
+		workers->Wait();
+
+	BOOST_FOREACH(Tile * tile, rebuilt)
+	{
+		if (tile->ref)
+		{
+			if (dtStatusFailed(navmesh->removeTile(tile->ref, 0, 0)))
+				throw std::logic_error("Pathfinding::NavMesh::Update: cannot remove tile");
+			tile->ref = 0;
+		}
+
+		// Nothing walkable left in this tile
+		if (!tile->navData)
+			continue;
+
+		if (dtStatusFailed(navmesh->addTile(tile->navData, tile->navDataSize, DT_TILE_FREE_DATA, 0, &tile->ref)))
+			throw std::bad_alloc();
+
+		tile->navData = 0;
+	}
+
+	return rebuilt.size();
+}
+}
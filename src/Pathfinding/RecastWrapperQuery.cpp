@@ -1,23 +1,87 @@
 #include "Pathfinding.h"
 #include "Detour/DetourCommon.h"
+#include "QueryWorkers.h"
 
-#include <boost/scoped_array.hpp>
+#include <algorithm>
 #include <stdlib.h>
 
 namespace Pathfinding
 {
-NavMesh::Path::Path(std::shared_ptr<dtNavMesh> navmeshref,
+static const int maxnodes = 2048;
+static const int buffersize = 10000;
+static const int maxvertices = 10000;
+
+NavMesh::QueryContext::QueryContext(std::shared_ptr<dtNavMesh> navmeshref, int maxnodes) :
+	navmesh(navmeshref),
+	navmeshquery(dtAllocNavMeshQuery(), dtFreeNavMeshQuery),
+	polys(buffersize),
+	straightpath(maxvertices * 3)
+{
+	if (!navmeshquery)
+		throw std::bad_alloc();
+
+	if (dtStatusFailed(navmeshquery->init(navmesh.get(), maxnodes)))
+		throw std::bad_alloc();
+}
+
+NavMesh::QueryContext & NavMesh::GetQueryContext() const
+{
+	QueryContext * context = queryContexts.get();
+
+	if (!context || context->navmesh != navmesh)
+	{
+		context = new QueryContext(navmesh, maxnodes);
+		queryContexts.reset(context);
+	}
+
+	return *context;
+}
+
+std::unique_ptr<NavMesh::QueryContext> NavMesh::CreateQueryContext() const
+{
+	return std::unique_ptr<QueryContext>(new QueryContext(navmesh, maxnodes));
+}
+
+std::future<NavMesh::Path> NavMesh::QueryAsync(Vertex const & start, Vertex const & end) const
+{
+	if (!workers)
+		throw std::logic_error("Pathfinding::NavMesh::QueryAsync: no worker threads");
+
+	typedef std::packaged_task<Path()> Task;
+	std::shared_ptr<Task> task(new Task(std::bind(
+		static_cast<Path (NavMesh::*)(Vertex const &, Vertex const &) const>(&NavMesh::Query),
+		this, start, end)));
+
+	workers->Push([task]() { (*task)(); });
+
+	return task->get_future();
+}
+
+void NavMesh::StartWorkers(int count)
+{
+	StopWorkers();
+
+	if (count > 0)
+		workers = std::unique_ptr<QueryWorkers>(new QueryWorkers(count));
+}
+
+void NavMesh::StopWorkers()
+{
+	workers.reset();
+}
+
+int NavMesh::WorkerCount() const
+{
+	return workers ? workers->Size() : 0;
+}
+
+NavMesh::Path::Path(QueryContext & context,
 		    const float * start,
 		    const float * end,
 		    const float * extent,
-		    const dtQueryFilter & filter) : navmesh(navmeshref), vertices()
+		    const dtQueryFilter & filter) : navmesh(context.navmesh), vertices()
 {
-	dtNavMeshQuery navmeshquery;
-	
-	if (dtStatusFailed(navmeshquery.init(navmesh.get(), 2048)))
-	{
-		throw std::bad_alloc();
-	}
+	dtNavMeshQuery & navmeshquery = context.query();
 
 	dtPolyRef startpoly, endpoly;
 
@@ -45,19 +109,16 @@ NavMesh::Path::Path(std::shared_ptr<dtNavMesh> navmeshref,
 		return;
 	}
 
-	
-	const int buffersize = 10000;
-
 	int npolys = 0;
 
-	boost::scoped_array<dtPolyRef> polys(new dtPolyRef[buffersize]);
+	dtPolyRef * polys = &context.polys[0];
 
 	dtStatus sta;
 	if (dtStatusFailed(sta = navmeshquery.findPath(
 		startpoly, endpoly,
 		start, end,
 		&filter,
-		polys.get(), &npolys, buffersize)))
+		polys, &npolys, context.polys.size())))
 	{
 		std::cerr << "Warning: findPath failed, status = " << sta << "\n";
 		return;
@@ -73,19 +134,57 @@ NavMesh::Path::Path(std::shared_ptr<dtNavMesh> navmeshref,
 			navmeshquery.closestPointOnPoly(polys[npolys - 1], end, end2);
 		}
 
+		straighten(context, start, end2, polys, npolys);
+	}
+}
+
+NavMesh::Path::Path(QueryContext & context,
+		    const float * start,
+		    const float * end,
+		    const dtPolyRef * polys,
+		    int npolys) : navmesh(context.navmesh), vertices()
+{
+	if (npolys > 0)
+		straighten(context, start, end, polys, npolys);
+}
 
-		const int maxvertices = 10000;
+void NavMesh::Path::straighten(QueryContext & context,
+			       const float * start,
+			       const float * end,
+			       const dtPolyRef * polys,
+			       int npolys)
+{
+	int nvertices = 0;
 
-		int nvertices = 0;
+	float * buffer = &context.straightpath[0];
 
-		boost::scoped_array<float> buffer(new float[maxvertices * 3]);
+	context.query().findStraightPath(start, end, polys, npolys, buffer, 0, 0, &nvertices, context.straightpath.size() / 3);
+	//std::cerr << "nvertices=" << nvertices << "\n"; 
+	vertices.resize(nvertices);
 
-		navmeshquery.findStraightPath(start, end2, polys.get(), npolys, buffer.get(), 0, 0, &nvertices, maxvertices);
-		//std::cerr << "nvertices=" << nvertices << "\n"; 
-		vertices.resize(nvertices);
+	for (int i = 0; i < nvertices; ++i)
+		vertices[i] = Vertex(buffer[3*i], buffer[3*i+1], buffer[3*i+2]);
 
-		for (int i = 0; i < nvertices; ++i)
-			vertices[i] = Vertex(buffer[3*i], buffer[3*i+1], buffer[3*i+2]);
+	polygons.assign(polys, polys + npolys);
+}
+
+size_t NavMesh::Path::NextCorner(Vertex const & _position, size_t corner, float distance) const
+{
+	const Vertex position(_position.x, 0, _position.z);
+	corner = std::max<size_t>(corner, 1);
+	while(corner + 1 < vertices.size())
+	{
+		const Vertex a(vertices[corner - 1].x, 0, vertices[corner - 1].z);
+		const Vertex b(vertices[corner].x, 0, vertices[corner].z);
+		const Vertex ab = b - a;
+
+		if (position.squaredDistance(b) > distance * distance &&
+		    (position - a).dotProduct(ab) < ab.squaredLength())
+			break;
+
+		corner++;
 	}
+
+	return corner;
 }
 }
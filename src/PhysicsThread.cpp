@@ -0,0 +1,97 @@
+/*
+    Copyright (C) 2012  Guillaume Meunier <guillaume.meunier@centraliens.net>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, version 3 of the License.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "PhysicsThread.h"
+
+#include "bullet/BulletDynamics/Dynamics/btDynamicsWorld.h"
+
+#include <algorithm>
+
+PhysicsThread::PhysicsThread(btDynamicsWorld & World, btScalar Step, int MaxSteps) :
+	_World(World),
+	_Step(Step),
+	_MaxSteps(MaxSteps),
+	_Time(0),
+	_Pending(0),
+	_Ticks(0),
+	_Running(false),
+	_Stopping(false)
+{
+	_Thread = std::thread(&PhysicsThread::Run, this);
+}
+
+PhysicsThread::~PhysicsThread()
+{
+	{
+		std::unique_lock<std::mutex> lock(_Mutex);
+		while (_Running)
+			_Done.wait(lock);
+		_Stopping = true;
+	}
+
+	_Wakeup.notify_one();
+	_Thread.join();
+}
+
+void PhysicsThread::Start(btScalar dt)
+{
+	{
+		std::unique_lock<std::mutex> lock(_Mutex);
+		_Pending = dt;
+		_Running = true;
+	}
+
+	_Wakeup.notify_one();
+}
+
+void PhysicsThread::Wait()
+{
+	std::unique_lock<std::mutex> lock(_Mutex);
+
+	while (_Running)
+		_Done.wait(lock);
+}
+
+void PhysicsThread::Run()
+{
+	std::unique_lock<std::mutex> lock(_Mutex);
+
+	while (true)
+	{
+		while (!_Running && !_Stopping)
+			_Wakeup.wait(lock);
+
+		if (_Stopping)
+			return;
+
+		_Time += _Pending;
+		const int ticks = (int)(_Time / _Step);
+		_Time -= ticks * _Step;
+		_Ticks = std::min(ticks, _MaxSteps);
+
+		lock.unlock();
+
+		// One tick per call: the motion states get the transform of each
+		// tick instead of one extrapolated by Bullet
+		for(int i = 0; i < _Ticks; ++i)
+			_World.stepSimulation(_Step, 1, _Step);
+
+		lock.lock();
+
+		_Running = false;
+		_Done.notify_all();
+	}
+}
@@ -0,0 +1,81 @@
+/*
+    Copyright (C) 2012  Guillaume Meunier <guillaume.meunier@centraliens.net>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, version 3 of the License.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef PHYSICSTHREAD_H
+#define PHYSICSTHREAD_H
+
+#include "bullet/LinearMath/btScalar.h"
+
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+class btDynamicsWorld;
+
+// Steps a dynamics world on its own thread, with a fixed time step and one
+// frame ahead of the rendering: Start() gives the duration of a frame and
+// returns at once, Wait() blocks until the ticks of that frame are done.
+// Between Wait() and Start(), the world and everything its tick callback
+// uses belong to the calling thread again.
+//
+// As with stepSimulation(), the time beyond MaxSteps ticks is dropped. The
+// time left after the last tick is kept for the next frame, GetAlpha()
+// gives it to interpolate the bodies between the last two ticks.
+class PhysicsThread
+{
+public:
+	PhysicsThread(btDynamicsWorld & World, btScalar Step, int MaxSteps);
+	~PhysicsThread();
+
+	void Start(btScalar dt);
+	void Wait();
+
+	// Ticks run for the last Start(), valid after Wait()
+	int GetTicks() const
+	{
+		return _Ticks;
+	}
+
+	// Time simulated after the last tick, in time steps
+	btScalar GetAlpha() const
+	{
+		return _Time / _Step;
+	}
+
+private:
+	btDynamicsWorld &                  _World;
+	const btScalar                     _Step;
+	const int                          _MaxSteps;
+
+	// Time given by Start() and not simulated yet
+	btScalar                           _Time;
+	btScalar                           _Pending;
+	int                                _Ticks;
+	bool                               _Running;
+	bool                               _Stopping;
+
+	std::mutex                         _Mutex;
+	std::condition_variable            _Wakeup;
+	std::condition_variable            _Done;
+	std::thread                        _Thread;
+
+	PhysicsThread(PhysicsThread const &);
+	PhysicsThread & operator=(PhysicsThread const &);
+
+	void Run();
+};
+
+#endif // PHYSICSTHREAD_H
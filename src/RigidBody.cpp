@@ -38,6 +38,10 @@ template<class T> RigidBody<T>::RigidBody(
 		btVector3(pos2.x, pos2.y, pos2.z));
 
 	_Node = node;
+
+	_PreviousRotation = _FromRotation = _ToRotation = _Rotation;
+	_PreviousPosition = _FromPosition = _ToPosition = _ShownPosition = _Position;
+	_Moved = false;
 }
 
 template<class T> void RigidBody<T>::setWorldTransform(const btTransform &worldTrans)
@@ -47,14 +51,36 @@ template<class T> void RigidBody<T>::setWorldTransform(const btTransform &worldT
 	btQuaternion q = worldTrans.getRotation();
 	btVector3 x = worldTrans.getOrigin();
 
+	_PreviousRotation = _Rotation;
+	_PreviousPosition = _Position;
+	_Moved = true;
+
 	_Rotation = Ogre::Quaternion(q.w(), q.x(), q.y(), q.z());
 	Ogre::Matrix3 M;
 	_Rotation.ToRotationMatrix(M);
 
 	_Position = Ogre::Vector3(x.x(), x.y(), x.z()) - M * _CoG;
+}
 
-	_Node->setPosition(_Position);
-	_Node->setOrientation(_Rotation);
+template<class T> void RigidBody<T>::publish(bool ticked, float alpha)
+{
+	// Bullet does not call setWorldTransform() for the sleeping bodies
+	if (ticked)
+	{
+		_FromRotation = _Moved ? _PreviousRotation : _Rotation;
+		_FromPosition = _Moved ? _PreviousPosition : _Position;
+		_ToRotation = _Rotation;
+		_ToPosition = _Position;
+		_Moved = false;
+	}
+
+	_ShownPosition = _FromPosition + (_ToPosition - _FromPosition) * alpha;
+
+	if (_Node)
+	{
+		_Node->setPosition(_ShownPosition);
+		_Node->setOrientation(Ogre::Quaternion::nlerp(alpha, _FromRotation, _ToRotation, true));
+	}
 }
 
 template<class T> RigidBody<T>::~RigidBody(void)
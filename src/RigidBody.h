@@ -32,15 +32,48 @@ public:
 		T * node);
 	virtual ~RigidBody();
 	virtual void getWorldTransform(btTransform &worldTrans) const;
+
+	// Called by Bullet after each tick the body moved in, possibly on
+	// another thread: the node is only moved by publish()
 	virtual void setWorldTransform(const btTransform &worldTrans);
 	void setNode(T * node);
 
+	// Position of the body at the last tick, kept without a node
+	Ogre::Vector3 const & getPosition() const
+	{
+		return _Position;
+	}
+
+	// Places the node between the last two ticks, alpha going from 0 (the
+	// tick before the last one) to 1 (the last one). Ticked is false when no
+	// tick ran since the last call, the node is then moved between the same
+	// ticks. Not to be called while the world is stepped.
+	void publish(bool ticked, float alpha);
+
+	// Position given to the node by publish(), kept without a node
+	Ogre::Vector3 const & getShownPosition() const
+	{
+		return _ShownPosition;
+	}
+
 private:
 	btTransform      _Transform;
 	Ogre::Vector3    _CoG;
 	Ogre::Quaternion _Rotation;
 	Ogre::Vector3    _Position;
 	T *              _Node;
+
+	// Tick before the last one, if the body moved since publish()
+	Ogre::Quaternion _PreviousRotation;
+	Ogre::Vector3    _PreviousPosition;
+	bool             _Moved;
+
+	// Ticks between which the node is placed
+	Ogre::Quaternion _FromRotation;
+	Ogre::Vector3    _FromPosition;
+	Ogre::Quaternion _ToRotation;
+	Ogre::Vector3    _ToPosition;
+	Ogre::Vector3    _ShownPosition;
 };
 
 #endif // RIGIDBODY_H
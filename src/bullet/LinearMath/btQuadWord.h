@@ -46,6 +46,21 @@ public:
 		return mVec128;
 	}
 protected:
+#elif defined (BT_USE_SSE)
+	union {
+		__m128 mVec128;
+		btScalar	m_floats[4];
+	};
+public:
+	SIMD_FORCE_INLINE	__m128	get128() const
+	{
+		return mVec128;
+	}
+	SIMD_FORCE_INLINE	void	set128(__m128 v128)
+	{
+		mVec128 = v128;
+	}
+protected:
 #else //__CELLOS_LV2__ __SPU__
 	btScalar	m_floats[4];
 #endif //__CELLOS_LV2__ __SPU__
@@ -130,6 +145,14 @@ protected:
 		//	:m_floats[0](btScalar(0.)),m_floats[1](btScalar(0.)),m_floats[2](btScalar(0.)),m_floats[3](btScalar(0.))
 		{
 		}
+
+#ifdef BT_USE_SSE
+  /**@brief Constructor from the four lanes of a SSE register */
+		SIMD_FORCE_INLINE explicit btQuadWord(__m128 v128)
+			: mVec128(v128)
+		{
+		}
+#endif
  
   /**@brief Three argument constructor (zeros w)
    * @param x Value of x
@@ -21,6 +21,20 @@ subject to the following restrictions:
 #include "btVector3.h"
 #include "btQuadWord.h"
 
+#ifdef BT_USE_SSE
+///Product of two quaternions, x, y, z, w in the lanes. Each lane adds its terms in the order
+///of the scalar code, the terms subtracted in the w lane have their sign flipped instead.
+SIMD_FORCE_INLINE __m128 btSseQuatMul(__m128 q1, __m128 q2)
+{
+	const __m128 signW = _mm_castsi128_ps(_mm_set_epi32((int)0x80000000, 0, 0, 0));
+	__m128 a = _mm_mul_ps(bt_pshufd_ps(q1, BT_SHUFFLE(3, 3, 3, 3)), q2);
+	__m128 b = _mm_xor_ps(_mm_mul_ps(bt_pshufd_ps(q1, BT_SHUFFLE(0, 1, 2, 0)), bt_pshufd_ps(q2, BT_SHUFFLE(3, 3, 3, 0))), signW);
+	__m128 c = _mm_xor_ps(_mm_mul_ps(bt_pshufd_ps(q1, BT_SHUFFLE(1, 2, 0, 1)), bt_pshufd_ps(q2, BT_SHUFFLE(2, 0, 1, 1))), signW);
+	__m128 d = _mm_mul_ps(bt_pshufd_ps(q1, BT_SHUFFLE(2, 0, 1, 2)), bt_pshufd_ps(q2, BT_SHUFFLE(1, 2, 0, 2)));
+	return _mm_sub_ps(_mm_add_ps(_mm_add_ps(a, b), c), d);
+}
+#endif //BT_USE_SSE
+
 /**@brief The btQuaternion implements quaternion to perform linear algebra rotations in combination with btMatrix3x3, btVector3 and btTransform. */
 class btQuaternion : public btQuadWord {
 public:
@@ -33,6 +47,12 @@ public:
 	btQuaternion(const btScalar& x, const btScalar& y, const btScalar& z, const btScalar& w) 
 		: btQuadWord(x, y, z, w) 
 	{}
+#ifdef BT_USE_SSE
+  /**@brief Constructor from the four lanes of a SSE register, w last */
+	SIMD_FORCE_INLINE explicit btQuaternion(__m128 v128)
+		: btQuadWord(v128)
+	{}
+#endif
   /**@brief Axis angle Constructor
    * @param axis The axis which the rotation is around
    * @param angle The magnitude of the rotation around the angle (Radians) */
@@ -107,7 +127,11 @@ public:
    * @param q The quaternion to add to this one */
 	SIMD_FORCE_INLINE	btQuaternion& operator+=(const btQuaternion& q)
 	{
+#ifdef BT_USE_SSE
+		mVec128 = _mm_add_ps(mVec128, q.mVec128);
+#else
 		m_floats[0] += q.x(); m_floats[1] += q.y(); m_floats[2] += q.z(); m_floats[3] += q.m_floats[3];
+#endif
 		return *this;
 	}
 
@@ -115,7 +139,11 @@ public:
    * @param q The quaternion to subtract from this one */
 	btQuaternion& operator-=(const btQuaternion& q) 
 	{
+#ifdef BT_USE_SSE
+		mVec128 = _mm_sub_ps(mVec128, q.mVec128);
+#else
 		m_floats[0] -= q.x(); m_floats[1] -= q.y(); m_floats[2] -= q.z(); m_floats[3] -= q.m_floats[3];
+#endif
 		return *this;
 	}
 
@@ -123,7 +151,11 @@ public:
    * @param s The scalar to scale by */
 	btQuaternion& operator*=(const btScalar& s)
 	{
+#ifdef BT_USE_SSE
+		mVec128 = _mm_mul_ps(mVec128, _mm_set1_ps(s));
+#else
 		m_floats[0] *= s; m_floats[1] *= s; m_floats[2] *= s; m_floats[3] *= s;
+#endif
 		return *this;
 	}
 
@@ -132,17 +164,29 @@ public:
    * Equivilant to this = this * q */
 	btQuaternion& operator*=(const btQuaternion& q)
 	{
+#ifdef BT_USE_SSE
+		mVec128 = btSseQuatMul(mVec128, q.mVec128);
+#else
 		setValue(m_floats[3] * q.x() + m_floats[0] * q.m_floats[3] + m_floats[1] * q.z() - m_floats[2] * q.y(),
 			m_floats[3] * q.y() + m_floats[1] * q.m_floats[3] + m_floats[2] * q.x() - m_floats[0] * q.z(),
 			m_floats[3] * q.z() + m_floats[2] * q.m_floats[3] + m_floats[0] * q.y() - m_floats[1] * q.x(),
 			m_floats[3] * q.m_floats[3] - m_floats[0] * q.x() - m_floats[1] * q.y() - m_floats[2] * q.z());
+#endif
 		return *this;
 	}
   /**@brief Return the dot product between this quaternion and another
    * @param q The other quaternion */
 	btScalar dot(const btQuaternion& q) const
 	{
+#ifdef BT_USE_SSE
+		__m128 p = _mm_mul_ps(mVec128, q.mVec128);
+		__m128 s = _mm_add_ss(p, bt_pshufd_ps(p, BT_SHUFFLE(1, 1, 1, 1)));
+		s = _mm_add_ss(s, _mm_movehl_ps(p, p));
+		s = _mm_add_ss(s, bt_pshufd_ps(p, BT_SHUFFLE(3, 3, 3, 3)));
+		return _mm_cvtss_f32(s);
+#else
 		return m_floats[0] * q.x() + m_floats[1] * q.y() + m_floats[2] * q.z() + m_floats[3] * q.m_floats[3];
+#endif
 	}
 
   /**@brief Return the length squared of the quaternion */
@@ -169,7 +213,11 @@ public:
 	SIMD_FORCE_INLINE btQuaternion
 	operator*(const btScalar& s) const
 	{
+#ifdef BT_USE_SSE
+		return btQuaternion(_mm_mul_ps(mVec128, _mm_set1_ps(s)));
+#else
 		return btQuaternion(x() * s, y() * s, z() * s, m_floats[3] * s);
+#endif
 	}
 
 
@@ -231,8 +279,12 @@ public:
 	SIMD_FORCE_INLINE btQuaternion
 	operator+(const btQuaternion& q2) const
 	{
+#ifdef BT_USE_SSE
+		return btQuaternion(_mm_add_ps(mVec128, q2.mVec128));
+#else
 		const btQuaternion& q1 = *this;
 		return btQuaternion(q1.x() + q2.x(), q1.y() + q2.y(), q1.z() + q2.z(), q1.m_floats[3] + q2.m_floats[3]);
+#endif
 	}
 
   /**@brief Return the difference between this quaternion and the other 
@@ -240,8 +292,12 @@ public:
 	SIMD_FORCE_INLINE btQuaternion
 	operator-(const btQuaternion& q2) const
 	{
+#ifdef BT_USE_SSE
+		return btQuaternion(_mm_sub_ps(mVec128, q2.mVec128));
+#else
 		const btQuaternion& q1 = *this;
 		return btQuaternion(q1.x() - q2.x(), q1.y() - q2.y(), q1.z() - q2.z(), q1.m_floats[3] - q2.m_floats[3]);
+#endif
 	}
 
   /**@brief Return the negative of this quaternion 
@@ -322,19 +378,32 @@ public:
 /**@brief Return the product of two quaternions */
 SIMD_FORCE_INLINE btQuaternion
 operator*(const btQuaternion& q1, const btQuaternion& q2) {
+#ifdef BT_USE_SSE
+	return btQuaternion(btSseQuatMul(q1.get128(), q2.get128()));
+#else
 	return btQuaternion(q1.w() * q2.x() + q1.x() * q2.w() + q1.y() * q2.z() - q1.z() * q2.y(),
 		q1.w() * q2.y() + q1.y() * q2.w() + q1.z() * q2.x() - q1.x() * q2.z(),
 		q1.w() * q2.z() + q1.z() * q2.w() + q1.x() * q2.y() - q1.y() * q2.x(),
 		q1.w() * q2.w() - q1.x() * q2.x() - q1.y() * q2.y() - q1.z() * q2.z()); 
+#endif
 }
 
 SIMD_FORCE_INLINE btQuaternion
 operator*(const btQuaternion& q, const btVector3& w)
 {
+#ifdef BT_USE_SSE
+	// x, y and z lanes as the scalar code, -x * w.x - y * w.y - z * w.z in the w lane
+	const __m128 signW = _mm_castsi128_ps(_mm_set_epi32((int)0x80000000, 0, 0, 0));
+	__m128 a = _mm_mul_ps(_mm_xor_ps(bt_pshufd_ps(q.get128(), BT_SHUFFLE(3, 3, 3, 0)), signW), bt_pshufd_ps(w.get128(), BT_SHUFFLE(0, 1, 2, 0)));
+	__m128 b = _mm_xor_ps(_mm_mul_ps(bt_pshufd_ps(q.get128(), BT_SHUFFLE(1, 2, 0, 1)), bt_pshufd_ps(w.get128(), BT_SHUFFLE(2, 0, 1, 1))), signW);
+	__m128 c = _mm_mul_ps(bt_pshufd_ps(q.get128(), BT_SHUFFLE(2, 0, 1, 2)), bt_pshufd_ps(w.get128(), BT_SHUFFLE(1, 2, 0, 2)));
+	return btQuaternion(_mm_sub_ps(_mm_add_ps(a, b), c));
+#else
 	return btQuaternion( q.w() * w.x() + q.y() * w.z() - q.z() * w.y(),
 		q.w() * w.y() + q.z() * w.x() - q.x() * w.z(),
 		q.w() * w.z() + q.x() * w.y() - q.y() * w.x(),
 		-q.x() * w.x() - q.y() * w.y() - q.z() * w.z()); 
+#endif
 }
 
 SIMD_FORCE_INLINE btQuaternion
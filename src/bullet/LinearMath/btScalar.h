@@ -167,6 +167,31 @@ inline int	btGetVersion()
 	#define btLikely(_c)  _c
 	#define btUnlikely(_c) _c
 
+#elif (defined (__GNUC__) && defined (__x86_64__) && defined (__SSE2__) && (!defined (BT_USE_DOUBLE_PRECISION)) && (!defined (BT_NO_SSE)))
+	///GCC and Clang on x86-64: SSE2 is always there and malloc returns 16 byte aligned blocks.
+	///Define BT_NO_SSE to build the scalar version, all the code of a program must agree on it.
+	#define BT_USE_SSE
+	#include <emmintrin.h>
+
+	#define SIMD_FORCE_INLINE inline
+	#define ATTRIBUTE_ALIGNED16(a) a __attribute__ ((aligned (16)))
+	#define ATTRIBUTE_ALIGNED64(a) a __attribute__ ((aligned (64)))
+	#define ATTRIBUTE_ALIGNED128(a) a __attribute__ ((aligned (128)))
+	#ifndef assert
+	#include <assert.h>
+	#endif
+
+	#if defined(DEBUG) || defined (_DEBUG)
+		#define btAssert assert
+	#else
+		#define btAssert(x)
+	#endif
+
+	//btFullAssert is optional, slows down a lot
+	#define btFullAssert(x)
+	#define btLikely(_c)   __builtin_expect((_c), 1)
+	#define btUnlikely(_c) __builtin_expect((_c), 0)
+
 #else
 
 		#define SIMD_FORCE_INLINE inline
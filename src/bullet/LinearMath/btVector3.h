@@ -29,6 +29,37 @@ subject to the following restrictions:
 #define btVector3DataName "btVector3FloatData"
 #endif //BT_USE_DOUBLE_PRECISION
 
+#ifdef BT_USE_SSE
+///Lanes taken by _mm_shuffle_ps, x first
+#define BT_SHUFFLE(x,y,z,w) ((w)<<6 | (z)<<4 | (y)<<2 | (x))
+#define bt_pshufd_ps( _a, _mask ) _mm_shuffle_ps((_a), (_a), (_mask) )
+
+///All the bits of x, y and z: the scalar code returns vectors with a null w
+SIMD_FORCE_INLINE __m128 btvFFF0Mask()
+{
+	return _mm_castsi128_ps(_mm_set_epi32(0, -1, -1, -1));
+}
+
+SIMD_FORCE_INLINE __m128 btvAbsMask()
+{
+	return _mm_castsi128_ps(_mm_set_epi32(0, 0x7fffffff, 0x7fffffff, 0x7fffffff));
+}
+
+SIMD_FORCE_INLINE __m128 btvSignMask()
+{
+	return _mm_castsi128_ps(_mm_set_epi32(0, (int)0x80000000, (int)0x80000000, (int)0x80000000));
+}
+
+///x + y + z of the products, added in the order of the scalar code so that both give the same bits
+SIMD_FORCE_INLINE float btSseDot3(__m128 v1, __m128 v2)
+{
+	__m128 p = _mm_mul_ps(v1, v2);
+	__m128 s = _mm_add_ss(p, bt_pshufd_ps(p, BT_SHUFFLE(1, 1, 1, 1)));
+	s = _mm_add_ss(s, _mm_movehl_ps(p, p));
+	return _mm_cvtss_f32(s);
+}
+#endif //BT_USE_SSE
+
 
 
 
@@ -72,6 +103,14 @@ public:
   /**@brief No initialization constructor */
 	SIMD_FORCE_INLINE btVector3() {}
 
+#ifdef BT_USE_SSE
+  /**@brief Constructor from the four lanes of a SSE register */
+	SIMD_FORCE_INLINE explicit btVector3(__m128 v128)
+		: mVec128(v128)
+	{
+	}
+#endif
+
  
 	
   /**@brief Constructor from scalars 
@@ -92,8 +131,11 @@ public:
  * @param The vector to add to this one */
 	SIMD_FORCE_INLINE btVector3& operator+=(const btVector3& v)
 	{
-
+#ifdef BT_USE_SSE
+		mVec128 = _mm_add_ps(mVec128, _mm_and_ps(v.mVec128, btvFFF0Mask()));
+#else
 		m_floats[0] += v.m_floats[0]; m_floats[1] += v.m_floats[1];m_floats[2] += v.m_floats[2];
+#endif
 		return *this;
 	}
 
@@ -102,14 +144,22 @@ public:
    * @param The vector to subtract */
 	SIMD_FORCE_INLINE btVector3& operator-=(const btVector3& v) 
 	{
+#ifdef BT_USE_SSE
+		mVec128 = _mm_sub_ps(mVec128, _mm_and_ps(v.mVec128, btvFFF0Mask()));
+#else
 		m_floats[0] -= v.m_floats[0]; m_floats[1] -= v.m_floats[1];m_floats[2] -= v.m_floats[2];
+#endif
 		return *this;
 	}
   /**@brief Scale the vector
    * @param s Scale factor */
 	SIMD_FORCE_INLINE btVector3& operator*=(const btScalar& s)
 	{
+#ifdef BT_USE_SSE
+		mVec128 = _mm_mul_ps(mVec128, _mm_setr_ps(s, s, s, 1));
+#else
 		m_floats[0] *= s; m_floats[1] *= s;m_floats[2] *= s;
+#endif
 		return *this;
 	}
 
@@ -125,7 +175,11 @@ public:
    * @param v The other vector in the dot product */
 	SIMD_FORCE_INLINE btScalar dot(const btVector3& v) const
 	{
+#ifdef BT_USE_SSE
+		return btSseDot3(mVec128, v.mVec128);
+#else
 		return m_floats[0] * v.m_floats[0] + m_floats[1] * v.m_floats[1] +m_floats[2] * v.m_floats[2];
+#endif
 	}
 
   /**@brief Return the length of the vector squared */
@@ -187,26 +241,40 @@ public:
   /**@brief Return a vector will the absolute values of each element */
 	SIMD_FORCE_INLINE btVector3 absolute() const 
 	{
+#ifdef BT_USE_SSE
+		return btVector3(_mm_and_ps(mVec128, btvAbsMask()));
+#else
 		return btVector3(
 			btFabs(m_floats[0]), 
 			btFabs(m_floats[1]), 
 			btFabs(m_floats[2]));
+#endif
 	}
   /**@brief Return the cross product between this and another vector 
    * @param v The other vector */
 	SIMD_FORCE_INLINE btVector3 cross(const btVector3& v) const
 	{
+#ifdef BT_USE_SSE
+		__m128 yzx = _mm_mul_ps(bt_pshufd_ps(mVec128, BT_SHUFFLE(1, 2, 0, 3)), bt_pshufd_ps(v.mVec128, BT_SHUFFLE(2, 0, 1, 3)));
+		__m128 zxy = _mm_mul_ps(bt_pshufd_ps(mVec128, BT_SHUFFLE(2, 0, 1, 3)), bt_pshufd_ps(v.mVec128, BT_SHUFFLE(1, 2, 0, 3)));
+		return btVector3(_mm_and_ps(_mm_sub_ps(yzx, zxy), btvFFF0Mask()));
+#else
 		return btVector3(
 			m_floats[1] * v.m_floats[2] -m_floats[2] * v.m_floats[1],
 			m_floats[2] * v.m_floats[0] - m_floats[0] * v.m_floats[2],
 			m_floats[0] * v.m_floats[1] - m_floats[1] * v.m_floats[0]);
+#endif
 	}
 
 	SIMD_FORCE_INLINE btScalar triple(const btVector3& v1, const btVector3& v2) const
 	{
+#ifdef BT_USE_SSE
+		return dot(v1.cross(v2));
+#else
 		return m_floats[0] * (v1.m_floats[1] * v2.m_floats[2] - v1.m_floats[2] * v2.m_floats[1]) + 
 			m_floats[1] * (v1.m_floats[2] * v2.m_floats[0] - v1.m_floats[0] * v2.m_floats[2]) + 
 			m_floats[2] * (v1.m_floats[0] * v2.m_floats[1] - v1.m_floats[1] * v2.m_floats[0]);
+#endif
 	}
 
   /**@brief Return the axis with the smallest value 
@@ -248,16 +316,25 @@ public:
    * @param t The ration of this to v (t = 0 => return this, t=1 => return other) */
 	SIMD_FORCE_INLINE btVector3 lerp(const btVector3& v, const btScalar& t) const 
 	{
+#ifdef BT_USE_SSE
+		__m128 r = _mm_add_ps(mVec128, _mm_mul_ps(_mm_sub_ps(v.mVec128, mVec128), _mm_set1_ps(t)));
+		return btVector3(_mm_and_ps(r, btvFFF0Mask()));
+#else
 		return btVector3(m_floats[0] + (v.m_floats[0] - m_floats[0]) * t,
 			m_floats[1] + (v.m_floats[1] - m_floats[1]) * t,
 			m_floats[2] + (v.m_floats[2] -m_floats[2]) * t);
+#endif
 	}
 
   /**@brief Elementwise multiply this vector by the other 
    * @param v The other vector */
 	SIMD_FORCE_INLINE btVector3& operator*=(const btVector3& v)
 	{
+#ifdef BT_USE_SSE
+		mVec128 = _mm_mul_ps(mVec128, _mm_or_ps(_mm_and_ps(v.mVec128, btvFFF0Mask()), _mm_setr_ps(0, 0, 0, 1)));
+#else
 		m_floats[0] *= v.m_floats[0]; m_floats[1] *= v.m_floats[1];m_floats[2] *= v.m_floats[2];
+#endif
 		return *this;
 	}
 
@@ -305,20 +382,29 @@ public:
    */
 		SIMD_FORCE_INLINE void	setMax(const btVector3& other)
 		{
+#ifdef BT_USE_SSE
+			// other first, to keep the current value when they are not ordered as btSetMax does
+			mVec128 = _mm_max_ps(other.mVec128, mVec128);
+#else
 			btSetMax(m_floats[0], other.m_floats[0]);
 			btSetMax(m_floats[1], other.m_floats[1]);
 			btSetMax(m_floats[2], other.m_floats[2]);
 			btSetMax(m_floats[3], other.w());
+#endif
 		}
   /**@brief Set each element to the min of the current values and the values of another btVector3
    * @param other The other btVector3 to compare with 
    */
 		SIMD_FORCE_INLINE void	setMin(const btVector3& other)
 		{
+#ifdef BT_USE_SSE
+			mVec128 = _mm_min_ps(other.mVec128, mVec128);
+#else
 			btSetMin(m_floats[0], other.m_floats[0]);
 			btSetMin(m_floats[1], other.m_floats[1]);
 			btSetMin(m_floats[2], other.m_floats[2]);
 			btSetMin(m_floats[3], other.w());
+#endif
 		}
 
 		SIMD_FORCE_INLINE void 	setValue(const btScalar& x, const btScalar& y, const btScalar& z)
@@ -369,34 +455,54 @@ public:
 SIMD_FORCE_INLINE btVector3 
 operator+(const btVector3& v1, const btVector3& v2) 
 {
+#ifdef BT_USE_SSE
+	return btVector3(_mm_and_ps(_mm_add_ps(v1.mVec128, v2.mVec128), btvFFF0Mask()));
+#else
 	return btVector3(v1.m_floats[0] + v2.m_floats[0], v1.m_floats[1] + v2.m_floats[1], v1.m_floats[2] + v2.m_floats[2]);
+#endif
 }
 
 /**@brief Return the elementwise product of two vectors */
 SIMD_FORCE_INLINE btVector3 
 operator*(const btVector3& v1, const btVector3& v2) 
 {
+#ifdef BT_USE_SSE
+	return btVector3(_mm_and_ps(_mm_mul_ps(v1.mVec128, v2.mVec128), btvFFF0Mask()));
+#else
 	return btVector3(v1.m_floats[0] * v2.m_floats[0], v1.m_floats[1] * v2.m_floats[1], v1.m_floats[2] * v2.m_floats[2]);
+#endif
 }
 
 /**@brief Return the difference between two vectors */
 SIMD_FORCE_INLINE btVector3 
 operator-(const btVector3& v1, const btVector3& v2)
 {
+#ifdef BT_USE_SSE
+	return btVector3(_mm_and_ps(_mm_sub_ps(v1.mVec128, v2.mVec128), btvFFF0Mask()));
+#else
 	return btVector3(v1.m_floats[0] - v2.m_floats[0], v1.m_floats[1] - v2.m_floats[1], v1.m_floats[2] - v2.m_floats[2]);
+#endif
 }
 /**@brief Return the negative of the vector */
 SIMD_FORCE_INLINE btVector3 
 operator-(const btVector3& v)
 {
+#ifdef BT_USE_SSE
+	return btVector3(_mm_and_ps(_mm_xor_ps(v.mVec128, btvSignMask()), btvFFF0Mask()));
+#else
 	return btVector3(-v.m_floats[0], -v.m_floats[1], -v.m_floats[2]);
+#endif
 }
 
 /**@brief Return the vector scaled by s */
 SIMD_FORCE_INLINE btVector3 
 operator*(const btVector3& v, const btScalar& s)
 {
+#ifdef BT_USE_SSE
+	return btVector3(_mm_and_ps(_mm_mul_ps(v.mVec128, _mm_set1_ps(s)), btvFFF0Mask()));
+#else
 	return btVector3(v.m_floats[0] * s, v.m_floats[1] * s, v.m_floats[2] * s);
+#endif
 }
 
 /**@brief Return the vector scaled by s */
@@ -20,6 +20,7 @@
 #include "environment.h"
 
 #include <boost/date_time.hpp>
+#include <thread>
 #include <OgreEntity.h>
 #include <OgreSceneManager.h>
 #include <OgreStaticGeometry.h>
@@ -29,8 +30,13 @@
 #include <boost/foreach.hpp>
 #include "OgreConverter.h"
 #include "OgreMeshManager.h"
+#include <OgreResourceGroupManager.h>
+#include <set>
+#include <iterator>
+#include "ContentHash.h"
+#include "CollisionCache.h"
+#include "btOgre/BtOgreExtras.h"
 #include "bullet/BulletCollision/CollisionShapes/btBvhTriangleMeshShape.h"
-#include "bullet/BulletCollision/CollisionShapes/btTriangleMesh.h"
 #include "bullet/btBulletDynamicsCommon.h"
 #include "bullet/btBulletCollisionCommon.h"
 #include "bullet/BulletCollision/CollisionDispatch/btInternalEdgeUtility.h"
@@ -75,26 +81,40 @@ static Ogre::Matrix4 getMatrix4(Environment::orientation_t orientation, Ogre::Ve
 	matrix.setTrans(translation);
 	return matrix;
 }
+static btTransform getTransform(Environment::orientation_t orientation, Ogre::Vector3 translation)
+{
+	return btTransform(BtOgre::Convert::toBullet(getQuaternion(orientation)), BtOgre::Convert::toBullet(translation));
+}
 
-Environment::Environment(Ogre::SceneManager* sceneManager, btDynamicsWorld& world, std::istream& level) :
+Environment::Environment(Ogre::SceneManager* sceneManager, btDynamicsWorld& world, std::istream& level, std::string const & cachedir) :
+	NavMeshUpdateBudget(boost::posix_time::milliseconds(2)),
 	_sceneManager(sceneManager),
 	_world(world),
+	_GoalField(_NavMesh),
 	_DebugDrawers(),
 	DebugAI(-1)
 {
-	for(int i = 0; i < 5; ++i)
+	// Without a scene manager (headless), only the physics and the
+	// pathfinding are set up
+	for(int i = 0; sceneManager && i < 5; ++i)
 	{
 		_DebugDrawers.push_back(std::unique_ptr<DebugDrawer>(new DebugDrawer(sceneManager, 0.5)));
 	}
 
 	boost::posix_time::ptime t1 = boost::posix_time::microsec_clock::universal_time();
-	while (!level.eof())
+
+	// The caches are keyed by the content of the level file and of the meshes
+	std::string text((std::istreambuf_iterator<char>(level)), std::istreambuf_iterator<char>());
+	std::istringstream levelstream(text);
+	std::set<std::string> meshes;
+
+	while (!levelstream.eof())
 	{
 		std::string MeshName;
 		std::string Orientation;
 		float x, y, z;
 
-		level >> MeshName >> x >> y >> z >> Orientation;
+		levelstream >> MeshName >> x >> y >> z >> Orientation;
 
 		if (MeshName.compare("") && (MeshName[0] != '#'))
 		{
@@ -115,14 +135,33 @@ Environment::Environment(Ogre::SceneManager* sceneManager, btDynamicsWorld& worl
 				throw std::invalid_argument(str.str());
 			}
 
-			Ogre::Entity * Entity = _sceneManager->createEntity(MeshName);
-			Entity->setCastShadows(false);
-			_blocks.push_back(Block(Entity, o, Ogre::Vector3(x,y,z)));
+			Ogre::MeshPtr Mesh = Ogre::MeshManager::getSingleton().load(MeshName, Ogre::ResourceGroupManager::AUTODETECT_RESOURCE_GROUP_NAME);
+			Ogre::Entity * Entity = 0;
+			if (_sceneManager)
+			{
+				Entity = _sceneManager->createEntity(MeshName);
+				Entity->setCastShadows(false);
+			}
+			_blocks.push_back(Block(Mesh, Entity, o, Ogre::Vector3(x,y,z)));
+			meshes.insert(MeshName);
 		}
 	}
 
+	// The collision shape of each mesh is cached on its own
+	ContentHash levelhash;
+	levelhash.Add(text);
+	std::map<std::string, uint64_t> meshhashes;
+	BOOST_FOREACH(std::string const & mesh, meshes)
+	{
+		ContentHash meshhash;
+		meshhash.Add(mesh);
+		meshhash.Add(Ogre::ResourceGroupManager::getSingleton().openResource(mesh)->getAsString());
+		meshhashes[mesh] = meshhash.Value();
+		levelhash.AddValue(meshhash.Value());
+	}
+
 	boost::posix_time::ptime t2 = boost::posix_time::microsec_clock::universal_time();
-	Ogre::StaticGeometry *sg = _sceneManager->createStaticGeometry("environment");
+	Ogre::StaticGeometry *sg = _sceneManager ? _sceneManager->createStaticGeometry("environment") : 0;
 
 	boost::posix_time::ptime t3 = boost::posix_time::microsec_clock::universal_time();
 
@@ -134,67 +173,162 @@ Environment::Environment(Ogre::SceneManager* sceneManager, btDynamicsWorld& worl
 	_NavMesh.CellHeight = 0.2;
 	_NavMesh.CellSize = 0.2;
 	_NavMesh.QueryExtent = Ogre::Vector3(10, 10, 10);
+	_NavMesh.TileSize = 64;
 
-	//for(auto const & block : _blocks)
-	BOOST_FOREACH(auto const & block, _blocks)
+	const std::string navmeshcache = cachedir + "/navmesh.cache";
+	const bool navmeshcached = _NavMesh.Load(navmeshcache, levelhash.Value());
+
+	// Each mesh is read once, for the navmesh and for its collision shape
+	std::map<std::string, std::shared_ptr<OgreConverter> > converters;
+	auto getConverter = [&](Ogre::Mesh & mesh) -> OgreConverter const &
+	{
+		std::shared_ptr<OgreConverter> & converter = converters[mesh.getName()];
+		if (!converter)
+			converter = std::make_shared<OgreConverter>(mesh);
+		return *converter;
+	};
+
+	// The navmesh needs the whole level
 	{
-		sg->addEntity(block._entity, block._position, getQuaternion(block._orientation));
+		std::vector<Ogre::Vector3> vertices;
+		std::vector<int> indices;
+
+		//for(auto const & block : _blocks)
+		BOOST_FOREACH(auto const & block, _blocks)
+		{
+			if (sg)
+				sg->addEntity(block._entity, block._position, getQuaternion(block._orientation));
 
-		OgreConverter converter(*block._entity);
-		Ogre::Matrix4 transform = getMatrix4(block._orientation, block._position);
-		converter.AddToTriMesh(transform, _TriMesh);
-		converter.AddToHeightField(transform, _NavMesh);
+			if (!navmeshcached)
+				getConverter(*block._mesh).AddToMesh(getMatrix4(block._orientation, block._position), vertices, indices);
+		}
+
+		if (!navmeshcached)
+			_NavMesh.AddMesh(vertices, indices, std::vector<unsigned char>(indices.size() / 3, 1));
 	}
 
 	boost::posix_time::ptime t4= boost::posix_time::microsec_clock::universal_time();
-	_NavMesh.Build();
+	if (!navmeshcached)
+	{
+		_NavMesh.Build();
+
+		try
+		{
+			_NavMesh.Save(navmeshcache, levelhash.Value());
+		}
+		catch(std::exception & e)
+		{
+			Ogre::LogManager::getSingleton().logMessage(std::string("Warning: ") + e.what());
+		}
+	}
+	_NavMesh.StartWorkers((int)std::thread::hardware_concurrency() - 1);
+	_PathScheduler = std::unique_ptr<Pathfinding::PathScheduler>(new Pathfinding::PathScheduler(_NavMesh));
+	_Crowd = std::unique_ptr<Pathfinding::Crowd>(new Pathfinding::Crowd(_NavMesh, *_PathScheduler));
 	boost::posix_time::ptime t5 = boost::posix_time::microsec_clock::universal_time();
 
-	for(int i = 0; i < 5; ++i)
-		_DebugDrawers[i]->clear();
+	if (!_DebugDrawers.empty())
+	{
+		for(int i = 0; i < 5; ++i)
+			_DebugDrawers[i]->clear();
 
-	_NavMesh.DebugDrawHeightfield(*_DebugDrawers[0]);
-	_NavMesh.DebugDrawCompactHeightfield(*_DebugDrawers[1]);
-	_NavMesh.DebugDrawRawContours(*_DebugDrawers[2]);
-	_NavMesh.DebugDrawContours(*_DebugDrawers[3]);
-	_NavMesh.DebugDrawPolyMeshDetail(*_DebugDrawers[4]);
+		_NavMesh.DebugDrawHeightfield(*_DebugDrawers[0]);
+		_NavMesh.DebugDrawCompactHeightfield(*_DebugDrawers[1]);
+		_NavMesh.DebugDrawRawContours(*_DebugDrawers[2]);
+		_NavMesh.DebugDrawContours(*_DebugDrawers[3]);
+		_NavMesh.DebugDrawPolyMeshDetail(*_DebugDrawers[4]);
 
-	for(int i = 0; i < 5; ++i)
-	{
-		_DebugDrawers[i]->setEnabled(true);
-		_DebugDrawers[i]->build();
-		_DebugDrawers[i]->setEnabled(false);
+		for(int i = 0; i < 5; ++i)
+		{
+			_DebugDrawers[i]->setEnabled(true);
+			_DebugDrawers[i]->build();
+			_DebugDrawers[i]->setEnabled(false);
+		}
 	}
 
 	boost::posix_time::ptime t6 = boost::posix_time::microsec_clock::universal_time();
 
-	_TriMeshShape = std::shared_ptr<btBvhTriangleMeshShape>(new btBvhTriangleMeshShape(&_TriMesh, true));
+	// One BVH per mesh, shared by the static bodies of the blocks. A
+	// btCompoundShape would hide the triangle mesh from
+	// btAdjustInternalEdgeContacts, which expects it as the root shape.
+	int collisioncached = 0;
+
+	//for(auto const & block : _blocks)
+	BOOST_FOREACH(auto const & block, _blocks)
+	{
+		const std::string & name = block._mesh->getName();
+		std::unique_ptr<BlockShape> & shape = _BlockShapes[name];
+
+		if (!shape)
+		{
+			shape = std::unique_ptr<BlockShape>(new BlockShape);
+
+			const std::string collisioncache = cachedir + "/collision-" + name + ".cache";
+			shape->Cache = CollisionCache::Load(collisioncache, meshhashes[name]);
+
+			if (shape->Cache)
+			{
+				shape->Shape = std::shared_ptr<btBvhTriangleMeshShape>(shape->Cache, shape->Cache->GetShape());
+				collisioncached++;
+			}
+			else
+			{
+				getConverter(*block._mesh).AddToMesh(Ogre::Matrix4::IDENTITY, shape->Vertices, shape->Indices);
+
+				// Ogre::Vector3 is 3 floats: Bullet reads the vertices in place
+				btIndexedMesh mesh;
+				mesh.m_numTriangles = shape->Indices.size() / 3;
+				mesh.m_triangleIndexBase = (const unsigned char *)shape->Indices.data();
+				mesh.m_triangleIndexStride = 3 * sizeof(int);
+				mesh.m_numVertices = shape->Vertices.size();
+				mesh.m_vertexBase = (const unsigned char *)shape->Vertices.data();
+				mesh.m_vertexStride = sizeof(Ogre::Vector3);
+				mesh.m_vertexType = PHY_FLOAT;
+				shape->Mesh.addIndexedMesh(mesh, PHY_INTEGER);
+
+				shape->Shape = std::make_shared<btBvhTriangleMeshShape>(&shape->Mesh, true);
+				btGenerateInternalEdgeInfo(shape->Shape.get(), &shape->TriangleInfoMap);
+
+				try
+				{
+					CollisionCache::Save(collisioncache, meshhashes[name], *shape->Shape);
+				}
+				catch(std::exception & e)
+				{
+					Ogre::LogManager::getSingleton().logMessage(std::string("Warning: ") + e.what());
+				}
+			}
+		}
+
+		btRigidBody::btRigidBodyConstructionInfo rbci(0, 0, shape->Shape.get());
+		rbci.m_startWorldTransform = getTransform(block._orientation, block._position);
+		_EnvBodies.push_back(std::unique_ptr<btRigidBody>(new btRigidBody(rbci)));
+	}
 	boost::posix_time::ptime t7 = boost::posix_time::microsec_clock::universal_time();
 
-	btRigidBody::btRigidBodyConstructionInfo rbci(0, 0, _TriMeshShape.get());
-	_EnvBody = std::shared_ptr<btRigidBody>(new btRigidBody(rbci));
+	BOOST_FOREACH(auto const & body, _EnvBodies)
+		_world.addRigidBody(body.get());
 	boost::posix_time::ptime t8 = boost::posix_time::microsec_clock::universal_time();
 
-	_world.addRigidBody(_EnvBody.get());
-	boost::posix_time::ptime t9 = boost::posix_time::microsec_clock::universal_time();
-
-	btTriangleInfoMap * triinfomap = new btTriangleInfoMap();
-	btGenerateInternalEdgeInfo(_TriMeshShape.get(), triinfomap);
 	gContactAddedCallback = CustomMaterialCombinerCallback;
-	_EnvBody->setCollisionFlags(_EnvBody->getCollisionFlags() | btCollisionObject::CF_CUSTOM_MATERIAL_CALLBACK | btCollisionObject::CF_STATIC_OBJECT | btCollisionObject::CF_DISABLE_VISUALIZE_OBJECT);
-	_EnvBody->setContactProcessingThreshold(0);
-	boost::posix_time::ptime t10 = boost::posix_time::microsec_clock::universal_time();
+	BOOST_FOREACH(auto const & body, _EnvBodies)
+	{
+		body->setCollisionFlags(body->getCollisionFlags() | btCollisionObject::CF_CUSTOM_MATERIAL_CALLBACK | btCollisionObject::CF_STATIC_OBJECT | btCollisionObject::CF_DISABLE_VISUALIZE_OBJECT);
+		body->setContactProcessingThreshold(0);
+	}
+	boost::posix_time::ptime t9 = boost::posix_time::microsec_clock::universal_time();
 
-	sg->build();
+	if (sg)
+		sg->build();
 	//sg->setCastShadows(true);
-	boost::posix_time::ptime t11 = boost::posix_time::microsec_clock::universal_time();
+	boost::posix_time::ptime t10 = boost::posix_time::microsec_clock::universal_time();
 
 	//for(auto const & block : _blocks)
 	BOOST_FOREACH(auto const & block, _blocks)
 	{
-		_sceneManager->destroyEntity(block._entity);
+		if (block._entity)
+			_sceneManager->destroyEntity(block._entity);
 	}
-	boost::posix_time::ptime t12 = boost::posix_time::microsec_clock::universal_time();
+	boost::posix_time::ptime t11 = boost::posix_time::microsec_clock::universal_time();
 
 	std::stringstream str;
 
@@ -206,48 +340,75 @@ Environment::Environment(Ogre::SceneManager* sceneManager, btDynamicsWorld& worl
 	Ogre::LogManager::getSingleton().logMessage(str.str());
 	str.str("");
 
-	str << "Convert geometry to Bullet and Recast:.  .  .  " << t4 - t3;
+	str << "Convert geometry to Recast:  .  .  .  .  .  .  " << t4 - t3;
+	Ogre::LogManager::getSingleton().logMessage(str.str());
+	str.str("");
+
+	str << (navmeshcached ? "Load NavMesh from cache: .  .  .  .  .  .  .  " : "Build NavMesh:.  .  .  .  .  .  .  .  .  .  .  ") << t5 - t4;
+	Ogre::LogManager::getSingleton().logMessage(str.str());
+	str.str("");
+
+	str << "    NavMesh cache: .  .  .  .  .  .  .  .  .  .  " << navmeshcache << (navmeshcached ? " (hit, " : " (miss, ") << levelhash.Hex() << ")";
+	Ogre::LogManager::getSingleton().logMessage(str.str());
+	str.str("");
+
+	Pathfinding::NavMesh::BuildStats const & navstats = _NavMesh.GetBuildStats();
+	str << "    NavMesh tiles: .  .  .  .  .  .  .  .  .  .  " << navstats.Tiles << " tiles, " << navstats.Polys << " polygons, " << navstats.Threads << " threads";
 	Ogre::LogManager::getSingleton().logMessage(str.str());
 	str.str("");
 
-	str << "Build NavMesh:.  .  .  .  .  .  .  .  .  .  .  " << t5 - t4;
+	str << "    NavMesh build, wall clock / sum of tiles:  " << navstats.Time << " / " << navstats.TileTime;
 	Ogre::LogManager::getSingleton().logMessage(str.str());
 	str.str("");
 
+	if (!navmeshcached)
+	{
+		str << "    NavMesh temporary memory:  .  .  .  .  .  " << navstats.Memory.TempBytes / 1024 << " KB in " << navstats.Memory.TempAllocations << " allocations, arena peak " << navstats.Memory.TempPeak / 1024 << " KB";
+		Ogre::LogManager::getSingleton().logMessage(str.str());
+		str.str("");
+
+		str << "    NavMesh permanent memory:  .  .  .  .  .  ";
+		for(int i = 0; i < Pathfinding::BuildArena::Stages; ++i)
+			str << (i ? ", " : "") << Pathfinding::BuildArena::StageName((Pathfinding::BuildArena::Stage)i) << " " << navstats.Memory.PermBytes[i] / 1024 << " KB";
+		Ogre::LogManager::getSingleton().logMessage(str.str());
+		str.str("");
+	}
+
 	str << "Create debug drawer:.  .  .  .  .  .  .  .  .  " << t6 - t5;
 	Ogre::LogManager::getSingleton().logMessage(str.str());
 	str.str("");
 
-	str << "Create triangle mesh shape:  .  .  .  .  .  .  " << t7 - t6;
+	str << "Create triangle mesh shapes and bodies:  .  .  " << t7 - t6;
 	Ogre::LogManager::getSingleton().logMessage(str.str());
 	str.str("");
 
-	str << "Create rigid body:  .  .  .  .  .  .  .  .  .  " << t8 - t7;
+	str << "    Collision shapes:.  .  .  .  .  .  .  .  .  " << _BlockShapes.size() << " meshes (" << collisioncached << " from cache) for " << _blocks.size() << " blocks";
 	Ogre::LogManager::getSingleton().logMessage(str.str());
 	str.str("");
 
-	str << "Add rigid body : .  .  .  .  .  .  .  .  .  .  " << t9 - t8;
+	str << "Add rigid bodies:.  .  .  .  .  .  .  .  .  .  " << t8 - t7;
 	Ogre::LogManager::getSingleton().logMessage(str.str());
 	str.str("");
 
-	str << "Add material callback: .  .  .  .  .  .  .  .  " << t10 - t9;
+	str << "Add material callback: .  .  .  .  .  .  .  .  " << t9 - t8;
 	Ogre::LogManager::getSingleton().logMessage(str.str());
 	str.str("");
 
-	str << "Build static geometry: .  .  .  .  .  .  .  .  " << t11 - t10;
+	str << "Build static geometry: .  .  .  .  .  .  .  .  " << t10 - t9;
 	Ogre::LogManager::getSingleton().logMessage(str.str());
 	str.str("");
 
-	str << "Clean up temporary variables:.  .  .  .  .  .  " << t12 - t11;
+	str << "Clean up temporary variables:.  .  .  .  .  .  " << t11 - t10;
 	Ogre::LogManager::getSingleton().logMessage(str.str());
 	str.str("");
 
-	str << "Total: . .  .  . .  .  .  .  .  .  .  .  .  .  " << t12 - t1;
+	str << "Total: . .  .  . .  .  .  .  .  .  .  .  .  .  " << t11 - t1;
 	Ogre::LogManager::getSingleton().logMessage(str.str());
 	str.str("");
 }
 
 Environment::~Environment()
 {
-	_world.removeRigidBody(_EnvBody.get());
+	BOOST_FOREACH(auto const & body, _EnvBodies)
+		_world.removeRigidBody(body.get());
 }
@@ -20,13 +20,22 @@
 #define ENVIRONMENT_H
 
 #include <vector>
+#include <map>
+#include <memory>
+#include <string>
 #include <iostream>
 #include <OgreVector3.h>
-#include "bullet/BulletCollision/CollisionShapes/btTriangleMesh.h"
+#include <OgreAxisAlignedBox.h>
+#include <OgreMesh.h>
+#include "bullet/BulletCollision/CollisionShapes/btTriangleIndexVertexArray.h"
 #include "bullet/BulletCollision/CollisionShapes/btBvhTriangleMeshShape.h"
+#include "bullet/BulletCollision/CollisionShapes/btTriangleInfoMap.h"
 #include "bullet/BulletDynamics/Dynamics/btRigidBody.h"
 #include "bullet/LinearMath/btDefaultMotionState.h"
 #include "Pathfinding/Pathfinding.h"
+#include "Pathfinding/PathScheduler.h"
+#include "Pathfinding/GoalField.h"
+#include "Pathfinding/Crowd.h"
 #include "DebugDrawer.h"
 
 namespace Ogre {
@@ -35,6 +44,7 @@ class Entity;
 }
 
 class btCollisionShape;
+class CollisionCache;
 class btDynamicsWorld;
 
 class Environment
@@ -43,15 +53,19 @@ public:
 	enum orientation_t { North, South, East, West};
 	struct Block
 	{
-		Block(Ogre::Entity * entity, orientation_t orientation, Ogre::Vector3 position):
-		_entity(entity), _orientation(orientation), _position(position) {}
+		Block(Ogre::MeshPtr mesh, Ogre::Entity * entity, orientation_t orientation, Ogre::Vector3 position):
+		_mesh(mesh), _entity(entity), _orientation(orientation), _position(position) {}
 
+		Ogre::MeshPtr _mesh;
+		// Null without a scene manager
 		Ogre::Entity * _entity;
 		orientation_t _orientation;
 		Ogre::Vector3 _position;
 	};
 
-	Environment(Ogre::SceneManager *sceneManager, btDynamicsWorld& world, std::istream &level);
+	// Data computed from the level is cached in cachedir. Without a scene
+	// manager, the level is not displayed
+	Environment(Ogre::SceneManager *sceneManager, btDynamicsWorld& world, std::istream &level, std::string const & cachedir);
 	~Environment();
 
 	Pathfinding::NavMesh::Path QueryPath(Ogre::Vector3 const & start, Ogre::Vector3 const & end) const
@@ -59,12 +73,65 @@ public:
 		return _NavMesh.Query(start, end);
 	}
 
+	Pathfinding::NavMesh const & GetNavMesh() const
+	{
+		return _NavMesh;
+	}
+
+	Pathfinding::PathScheduler::RequestPtr RequestPath(Ogre::Vector3 const & start, Ogre::Vector3 const & end)
+	{
+		return _PathScheduler->Submit(start, end);
+	}
+
+	// Crowd of the agents steered together, updated by UpdatePathfinding()
+	Pathfinding::Crowd & GetCrowd()
+	{
+		return *_Crowd;
+	}
+
+	// Obstacles are taken into account by the navmesh over the next calls
+	// to UpdatePathfinding(), the box is axis aligned
+	Pathfinding::NavMesh::ObstacleRef AddObstacle(Ogre::Vector3 const & position, float radius, float height)
+	{
+		return _NavMesh.AddCylinderObstacle(position, radius, height);
+	}
+
+	Pathfinding::NavMesh::ObstacleRef AddObstacle(Ogre::AxisAlignedBox const & box)
+	{
+		return _NavMesh.AddBoxObstacle(box.getMinimum(), box.getMaximum());
+	}
+
+	void RemoveObstacle(Pathfinding::NavMesh::ObstacleRef ref)
+	{
+		_NavMesh.RemoveObstacle(ref);
+	}
+
+	// Rebuilds the navmesh tiles changed by obstacles within
+	// NavMeshUpdateBudget, steers the crowd, then runs the path requests
+	void UpdatePathfinding(float dt)
+	{
+		if (_NavMesh.Update(NavMeshUpdateBudget))
+			_GoalField.Invalidate();
+
+		_Crowd->Update(dt);
+		_PathScheduler->Update();
+	}
+
+	boost::posix_time::time_duration NavMeshUpdateBudget;
+
+	// Field shared by all the agents chasing the same target
+	Pathfinding::GoalField const & UpdateGoalField(Ogre::Vector3 const & goal)
+	{
+		_GoalField.Build(goal);
+		return _GoalField;
+	}
+
 	void DebugSwitch()
 	{
 		DebugAI++;
 		if (DebugAI > 5) DebugAI = 0;
 		
-		for(int i = 0; i < 5; ++i)
+		for(int i = 0; i < (int)_DebugDrawers.size(); ++i)
 			_DebugDrawers[i]->setEnabled(i == DebugAI);
 	}
 
@@ -72,10 +139,25 @@ private:
 	Ogre::SceneManager * _sceneManager;
 	btDynamicsWorld& _world;
 	std::vector<Block> _blocks;
-	btTriangleMesh _TriMesh;
-	std::shared_ptr<btBvhTriangleMeshShape> _TriMeshShape;
-	std::shared_ptr<btRigidBody> _EnvBody;
+	// Collision shape of a block mesh, in the coordinates of the mesh and
+	// shared by all the blocks using it. The geometry is used in place by
+	// Bullet unless the shape comes from the cache.
+	struct BlockShape
+	{
+		std::vector<Ogre::Vector3> Vertices;
+		std::vector<int> Indices;
+		btTriangleIndexVertexArray Mesh;
+		btTriangleInfoMap TriangleInfoMap;
+		std::shared_ptr<CollisionCache> Cache;
+		std::shared_ptr<btBvhTriangleMeshShape> Shape;
+	};
+	std::map<std::string, std::unique_ptr<BlockShape> > _BlockShapes;
+	// One static body per block
+	std::vector<std::unique_ptr<btRigidBody> > _EnvBodies;
 	Pathfinding::NavMesh _NavMesh;
+	std::unique_ptr<Pathfinding::PathScheduler> _PathScheduler;
+	Pathfinding::GoalField _GoalField;
+	std::unique_ptr<Pathfinding::Crowd> _Crowd;
 	std::vector<std::unique_ptr<DebugDrawer> > _DebugDrawers;
 	int DebugAI;
 };
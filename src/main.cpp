@@ -22,25 +22,53 @@
 
 #include <boost/filesystem.hpp>
 #include <stdexcept>
+#include <cstdlib>
+#include <cstring>
+#include <climits>
 
 #ifdef _WINDOWS
 #include <windows.h>
 #include <shlobj.h>
 
-int main(/* int argc, char *argv[] */);
+int main(int argc, char *argv[]);
 
 INT WINAPI WinMain( HINSTANCE hInst, HINSTANCE, LPSTR strCmdLine, INT )
 {
-	return main(/* 0, 0 */);
+	return main(__argc, __argv);
 }
 #endif
 
-int main(/* int argc, char *argv[] */)
+int main(int argc, char *argv[])
 {
 #ifdef NDEBUG
 	try
 	{
 #endif
+		// --headless [frames]: runs the game without rendering nor input,
+		// with a fixed time step, as fast as possible
+		bool Headless = false;
+		int HeadlessFrames = 3600;
+		for(int i = 1; i < argc; ++i)
+		{
+			if (!strcmp(argv[i], "--headless"))
+			{
+				Headless = true;
+
+				// The next argument is the number of frames if it is a
+				// whole positive number
+				if (i + 1 < argc)
+				{
+					char * end;
+					const long frames = strtol(argv[i + 1], &end, 10);
+					if (end != argv[i + 1] && *end == 0 && frames > 0 && frames <= INT_MAX)
+					{
+						HeadlessFrames = frames;
+						++i;
+					}
+				}
+			}
+		}
+
 #ifdef _WINDOWS
 		char buf[MAX_PATH];
 		if (!SUCCEEDED(SHGetFolderPath(NULL, CSIDL_LOCAL_APPDATA, NULL, SHGFP_TYPE_CURRENT, buf)))
@@ -69,10 +97,13 @@ int main(/* int argc, char *argv[] */)
 
 		boost::filesystem::create_directories(SettingsDir);
 
-		AppStateManager manager(SettingsDir);
+		AppStateManager manager(SettingsDir, Headless);
 		//std::shared_ptr<MainMenu> menu(new MainMenu);
 		std::shared_ptr<Game> menu(new Game);
-		manager.MainLoop(menu);
+		if (Headless)
+			manager.HeadlessLoop(menu, 1. / 60, HeadlessFrames);
+		else
+			manager.MainLoop(menu);
 #ifdef NDEBUG
 	}
 
@@ -0,0 +1,131 @@
+/*
+    Animation benchmark: N characters animated without an entity, as in the
+    headless mode of the game, with the blend states of CharacterController
+    (jumping, running, idle, dancing). Update() then also applies the
+    animations to the skeleton of each character.
+
+    bench_animation [N] [frames]
+
+    Two runs are timed: in the first one every character keeps running,
+    in the second one each character changes state every half second, at
+    a different frame from its neighbours. The cost of a frame divided by
+    the number of characters is written, in microseconds per character.
+
+    It links with Ogre (pkg-config OGRE) and loads Sinbad.mesh from
+    ../resources/models/Sinbad.zip: run it from the tests directory.
+*/
+
+#include "../src/CharacterAnimation.h"
+
+#include <OgreRoot.h>
+#include <OgreLogManager.h>
+#include <OgreMeshManager.h>
+#include <OgreResourceGroupManager.h>
+#include <OgreDefaultHardwareBufferManager.h>
+
+#include <boost/date_time.hpp>
+
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <vector>
+
+// The animations of a character, set up as in CharacterController
+struct Character
+{
+	CharacterAnimation animations;
+	CharacterAnimation::Handle runbase;
+	CharacterAnimation::Handle runtop;
+	CharacterAnimation::BlendState states[4];
+
+	Character(Ogre::MeshPtr const & mesh) : animations(0, mesh)
+	{
+		runbase = animations.Find("RunBase");
+		runtop = animations.Find("RunTop");
+
+		for(int i = 0; i < 4; ++i)
+			states[i] = animations.AddBlendState();
+
+		animations.AddToBlendState(states[0], animations.Find("JumpLoop"));
+		animations.AddToBlendState(states[1], runbase);
+		animations.AddToBlendState(states[1], runtop);
+		animations.AddToBlendState(states[2], animations.Find("IdleBase"));
+		animations.AddToBlendState(states[2], animations.Find("IdleTop"));
+		animations.AddToBlendState(states[3], animations.Find("Dance"));
+	}
+
+	void Update(int state, float speed, float dt)
+	{
+		if (state == 1)
+		{
+			animations.SetSpeed(runbase, speed / 10);
+			animations.SetSpeed(runtop, speed / 10);
+		}
+
+		animations.SetBlendState(states[state]);
+		animations.Update(dt);
+	}
+};
+
+int main(int argc, char * argv[])
+{
+	const int count = argc > 1 ? atoi(argv[1]) : 500;
+	const int frames = argc > 2 ? atoi(argv[2]) : 600;
+	const float dt = 1.0 / 60;
+
+	// The mesh is read from the resources of the game, relative to tests/
+	const char * resources = "../resources/models/Sinbad.zip";
+	if (!std::ifstream(resources))
+	{
+		std::cerr << "bench_animation: cannot open " << resources << ", run it from the tests directory\n";
+		return 1;
+	}
+
+	// Ogre without a render system, the meshes in system memory
+	Ogre::LogManager * logs = new Ogre::LogManager;
+	logs->createLog("bench_animation.log", true, false, true);
+	Ogre::Root * root = new Ogre::Root("", "", "");
+	Ogre::DefaultHardwareBufferManager * buffers = new Ogre::DefaultHardwareBufferManager;
+	Ogre::ResourceGroupManager::getSingleton().addResourceLocation(resources, "Zip");
+	Ogre::MeshPtr mesh = Ogre::MeshManager::getSingleton().load("Sinbad.mesh", Ogre::ResourceGroupManager::AUTODETECT_RESOURCE_GROUP_NAME);
+
+	for(int run = 0; run < 2; ++run)
+	{
+		std::vector<std::unique_ptr<Character> > characters;
+		for(int i = 0; i < count; ++i)
+			characters.push_back(std::unique_ptr<Character>(new Character(mesh)));
+
+		std::vector<double> samples;
+		for(int frame = 0; frame < frames; ++frame)
+		{
+			boost::posix_time::ptime t = boost::posix_time::microsec_clock::universal_time();
+
+			for(int i = 0; i < count; ++i)
+			{
+				const int state = run == 0 ? 1 : ((frame + 7 * i) / 30) % 4;
+				characters[i]->Update(state, 5 + i % 5, dt);
+			}
+
+			samples.push_back((boost::posix_time::microsec_clock::universal_time() - t).total_microseconds() / (double)count);
+		}
+
+		std::sort(samples.begin(), samples.end());
+		double mean = 0;
+		for(size_t i = 0; i < samples.size(); ++i)
+			mean += samples[i];
+		mean /= samples.size();
+
+		std::cout << (run == 0 ? "steady:    " : "switching: ")
+			<< count << " characters, " << frames << " frames, "
+			<< mean << " us/character (p50 " << samples[samples.size() / 2]
+			<< ", p99 " << samples[samples.size() * 99 / 100] << ")\n";
+	}
+
+	mesh.setNull();
+	delete root;
+	delete buffers;
+	delete logs;
+
+	return 0;
+}
@@ -0,0 +1,105 @@
+/*
+    Path corridor benchmark: agents follow a moving target, either running
+    a full query at every update or patching a PathCorridor and querying
+    only when it becomes invalid. Prints the number of full queries and
+    the time spent planning.
+*/
+
+#include "../src/Pathfinding/Pathfinding.h"
+#include "../src/Pathfinding/PathCorridor.h"
+#include "bench_level.h"
+
+#include <boost/date_time.hpp>
+
+#include <iostream>
+
+// Moves position toward the second vertex of the path
+static void Walk(Vertex & position, Pathfinding::NavMesh::Path const & path, float distance)
+{
+	for(size_t i = 1; i < path.size() && distance > 0; ++i)
+	{
+		Vertex d = path[i] - position;
+		float length = d.length();
+		if (length <= distance)
+		{
+			position = path[i];
+			distance -= length;
+		}
+		else
+		{
+			position += d * (distance / length);
+			distance = 0;
+		}
+	}
+}
+
+int main(int argc, char * argv[])
+{
+	const int agents = argc > 1 ? atoi(argv[1]) : 64;
+	const int ticks = argc > 2 ? atoi(argv[2]) : 600;
+	const float dt = 1.0 / 60;
+	const int replanTicks = 6;
+	const float speed = 3;
+
+	Pathfinding::NavMesh navmesh;
+	BuildLevel(navmesh);
+
+	std::vector<Vertex> start;
+	srand(42);
+	for(int i = 0; i < agents; ++i)
+		start.push_back(Vertex(Random(-38, 38), 0, Random(-38, 38)));
+
+	for(int mode = 0; mode < 2; ++mode)
+	{
+		std::vector<Vertex> positions = start;
+		std::vector<Pathfinding::NavMesh::Path> paths(agents);
+		std::vector<std::unique_ptr<Pathfinding::PathCorridor> > corridors;
+		for(int i = 0; i < agents; ++i)
+			corridors.push_back(std::unique_ptr<Pathfinding::PathCorridor>(new Pathfinding::PathCorridor(navmesh)));
+
+		int queries = 0;
+		int updates = 0;
+		boost::posix_time::time_duration planning;
+
+		for(int tick = 0; tick < ticks; ++tick)
+		{
+			float angle = tick * dt * 0.2;
+			Vertex target(30 * cos(angle), 0, 30 * sin(angle));
+
+			if (tick % replanTicks == 0)
+			{
+				boost::posix_time::ptime t1 = boost::posix_time::microsec_clock::universal_time();
+
+				for(int i = 0; i < agents; ++i)
+				{
+					Pathfinding::PathCorridor & corridor = *corridors[i];
+					++updates;
+
+					if (mode == 1 && corridor.MovePosition(positions[i]) && corridor.MoveTarget(target) && corridor.IsValid())
+					{
+						paths[i] = corridor.GetPath();
+					}
+					else
+					{
+						paths[i] = navmesh.Query(positions[i], target);
+						corridor.SetPath(paths[i]);
+						++queries;
+					}
+				}
+
+				planning += boost::posix_time::microsec_clock::universal_time() - t1;
+			}
+
+			for(int i = 0; i < agents; ++i)
+				Walk(positions[i], paths[i], speed * dt);
+		}
+
+		std::cout << (mode == 0 ? "Full query:    " : "Path corridor: ")
+			<< agents << " agents, " << ticks << " ticks, "
+			<< queries << " / " << updates << " full queries, "
+			<< planning.total_microseconds() * 1e-3 << " ms planning, "
+			<< planning.total_microseconds() / (double)updates << " us/update\n";
+	}
+
+	return 0;
+}
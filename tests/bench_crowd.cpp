@@ -0,0 +1,90 @@
+/*
+    Crowd benchmark: two groups of agents cross each other on the test
+    level, with and without local avoidance. The agents are moved by a
+    simple integration instead of the physics, and the benchmark counts
+    how often two of them overlap, which is what the physics would have
+    to resolve, and the time spent in Crowd::Update().
+*/
+
+#include "../src/Pathfinding/Pathfinding.h"
+#include "../src/Pathfinding/PathScheduler.h"
+#include "../src/Pathfinding/Crowd.h"
+#include "bench_level.h"
+
+#include <boost/date_time.hpp>
+
+#include <iostream>
+
+int main(int argc, char * argv[])
+{
+	const int agents = argc > 1 ? atoi(argv[1]) : 64;
+	const int ticks = argc > 2 ? atoi(argv[2]) : 1200;
+	const float dt = 1.0 / 60;
+	const float radius = 0.5;
+	const float speed = 3;
+
+	Pathfinding::NavMesh navmesh;
+	BuildLevel(navmesh);
+
+	for(int mode = 0; mode < 2; ++mode)
+	{
+		Pathfinding::PathScheduler scheduler(navmesh);
+		Pathfinding::Crowd crowd(navmesh, scheduler);
+		crowd.Avoidance = mode == 1;
+
+		// Two groups on each side of the level, in rows 1.5 m apart, going
+		// to the other side
+		std::vector<Vertex> positions;
+		std::vector<Vertex> velocities(agents, Vertex::ZERO);
+		std::vector<Vertex> targets;
+		std::vector<Pathfinding::Crowd::AgentRef> refs;
+		for(int i = 0; i < agents; ++i)
+		{
+			float side = i % 2 ? 1 : -1;
+			int row = i / 2 % 8;
+			int column = i / 16;
+			Vertex position(side * (18 + 1.5 * column), 0, 1.5 * (row - 3.5));
+			positions.push_back(position);
+			targets.push_back(Vertex(-position.x, 0, position.z));
+			refs.push_back(crowd.Add(position, radius, speed));
+			crowd.SetTarget(refs.back(), targets.back());
+		}
+
+		int overlaps = 0;
+		boost::posix_time::time_duration time;
+
+		for(int tick = 0; tick < ticks; ++tick)
+		{
+			for(int i = 0; i < agents; ++i)
+				crowd.SetState(refs[i], positions[i], velocities[i]);
+
+			boost::posix_time::ptime t1 = boost::posix_time::microsec_clock::universal_time();
+			crowd.Update(dt);
+			time += boost::posix_time::microsec_clock::universal_time() - t1;
+			scheduler.Update();
+
+			// Same response as the force applied by CharacterController
+			for(int i = 0; i < agents; ++i)
+			{
+				velocities[i] += (crowd.GetVelocity(refs[i]) - velocities[i]) * std::min(1.0f, 10 * dt);
+				positions[i] += velocities[i] * dt;
+			}
+
+			for(int i = 0; i < agents; ++i)
+				for(int j = i + 1; j < agents; ++j)
+					if (positions[i].squaredDistance(positions[j]) < 4 * radius * radius)
+						overlaps++;
+		}
+
+		float distance = 0;
+		for(int i = 0; i < agents; ++i)
+			distance += positions[i].distance(targets[i]) / agents;
+
+		std::cout << (mode == 0 ? "No avoidance: " : "Avoidance:    ")
+			<< agents << " agents, " << ticks << " ticks, "
+			<< overlaps << " overlapping pairs, " << distance << " m from the targets, "
+			<< time.total_microseconds() / (double)ticks << " us/update\n";
+	}
+
+	return 0;
+}
@@ -0,0 +1,502 @@
+/*
+    Horde benchmark: N characters chase a target running in circles on the
+    test level, with the physics, the pathfinding and the animation of the
+    game, for a number of fixed ticks. Each stage is timed at every tick,
+    and its mean and percentiles are written as text, CSV or JSON for each
+    number of characters, to get scaling curves.
+
+    The characters are CharacterControllers without a scene manager, as in
+    the headless mode of the game: Ogre only loads their mesh and animates
+    their skeleton.
+
+    bench_horde [--csv | --json] [--corridor] [--ticks K] [--threads T] [N...]
+
+    --corridor steers each character on its own with UpdateAITarget() and
+    UpdateAI() instead of the crowd used by the game.
+
+    --threads sets the number of threads of the narrowphase, of the solver
+    and of the animation jobs, one per core by default as in the game.
+
+    It links with Ogre (pkg-config OGRE) and loads Sinbad.mesh from
+    ../resources/models/Sinbad.zip: run it from the tests directory.
+*/
+
+#include "../src/CharacterController.h"
+#include "../src/JobSystem.h"
+#include "../src/ParallelDispatcher.h"
+#include "../src/ParallelSolver.h"
+#include "../src/Pathfinding/Pathfinding.h"
+#include "../src/Pathfinding/PathScheduler.h"
+#include "../src/Pathfinding/GoalField.h"
+#include "../src/Pathfinding/Crowd.h"
+#include "bench_level.h"
+
+#include "btBulletDynamicsCommon.h"
+
+#include <OgreRoot.h>
+#include <OgreLogManager.h>
+#include <OgreResourceGroupManager.h>
+#include <OgreDefaultHardwareBufferManager.h>
+
+#include <boost/date_time.hpp>
+#include <boost/foreach.hpp>
+
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include <string.h>
+
+enum Stage
+{
+	Broadphase,
+	Narrowphase,
+	Islands,
+	Solver,
+	Integration,
+	Contacts,
+	GoalField,
+	Crowd,
+	UpdateAITarget,
+	UpdateAI,
+	PathRequests,
+	Characters,
+	Animation,
+	Frame,
+	Stages
+};
+
+static const char * StageNames[Stages] = {
+	"broadphase",
+	"narrowphase",
+	"islands",
+	"solver",
+	"integration",
+	"contact index",
+	"goal field",
+	"crowd",
+	"UpdateAITarget",
+	"UpdateAI",
+	"path requests",
+	"characters",
+	"animation",
+	"frame"
+};
+
+// Time of each stage at every tick, in microseconds
+class Timings
+{
+	double current[Stages];
+	bool measured[Stages];
+
+public:
+	std::vector<double> Samples[Stages];
+
+	Timings()
+	{
+		std::fill(current, current + Stages, 0);
+		std::fill(measured, measured + Stages, false);
+	}
+
+	// Adds the time since start to the stage
+	void Add(Stage stage, boost::posix_time::ptime const & start)
+	{
+		current[stage] += (boost::posix_time::microsec_clock::universal_time() - start).total_microseconds();
+		measured[stage] = true;
+	}
+
+	void EndTick()
+	{
+		for(int i = 0; i < Stages; ++i)
+		{
+			if (measured[i])
+				Samples[i].push_back(current[i]);
+			current[i] = 0;
+		}
+	}
+};
+
+static boost::posix_time::ptime Now()
+{
+	return boost::posix_time::microsec_clock::universal_time();
+}
+
+// Same steps as btDiscreteDynamicsWorld, timed
+class ProfiledWorld : public btDiscreteDynamicsWorld
+{
+	Timings & timings;
+
+public:
+	ProfiledWorld(btDispatcher * dispatcher, btBroadphaseInterface * broadphase, btConstraintSolver * solver, btCollisionConfiguration * configuration, Timings & _timings) :
+		btDiscreteDynamicsWorld(dispatcher, broadphase, solver, configuration),
+		timings(_timings)
+	{
+	}
+
+	virtual void performDiscreteCollisionDetection()
+	{
+		boost::posix_time::ptime t = Now();
+		updateAabbs();
+		m_broadphasePairCache->calculateOverlappingPairs(m_dispatcher1);
+		timings.Add(Broadphase, t);
+
+		t = Now();
+		m_dispatcher1->dispatchAllCollisionPairs(m_broadphasePairCache->getOverlappingPairCache(), getDispatchInfo(), m_dispatcher1);
+		timings.Add(Narrowphase, t);
+	}
+
+protected:
+	virtual void predictUnconstraintMotion(btScalar timeStep)
+	{
+		boost::posix_time::ptime t = Now();
+		btDiscreteDynamicsWorld::predictUnconstraintMotion(timeStep);
+		timings.Add(Integration, t);
+	}
+
+	virtual void calculateSimulationIslands()
+	{
+		boost::posix_time::ptime t = Now();
+		btDiscreteDynamicsWorld::calculateSimulationIslands();
+		timings.Add(Islands, t);
+	}
+
+	virtual void solveConstraints(btContactSolverInfo & solverInfo)
+	{
+		boost::posix_time::ptime t = Now();
+		btDiscreteDynamicsWorld::solveConstraints(solverInfo);
+		timings.Add(Solver, t);
+	}
+
+	virtual void integrateTransforms(btScalar timeStep)
+	{
+		boost::posix_time::ptime t = Now();
+		btDiscreteDynamicsWorld::integrateTransforms(timeStep);
+		timings.Add(Integration, t);
+	}
+};
+
+// One run of the benchmark: the world and the characters of the game,
+// with a tick callback doing the same as Game::BulletCallback()
+struct Horde
+{
+	Pathfinding::NavMesh & navmesh;
+	Timings & timings;
+	bool corridor;
+
+	// The narrowphase, the solver and the animation of the characters, in
+	// batches as in Game::BuildFrame(), share the threads
+	JobSystem jobs;
+	JobGraph animation;
+	float frametime;
+
+	btDefaultCollisionConfiguration configuration;
+	ParallelDispatcher dispatcher;
+	btDbvtBroadphase broadphase;
+	ParallelSolver solver;
+	std::shared_ptr<btDynamicsWorld> world;
+	ContactIndex contacts;
+
+	btTriangleMesh levelmesh;
+	std::unique_ptr<btBvhTriangleMeshShape> levelshape;
+	std::unique_ptr<btRigidBody> levelbody;
+
+	Pathfinding::PathScheduler scheduler;
+	Pathfinding::GoalField goalfield;
+	Pathfinding::Crowd crowd;
+
+	std::vector<std::shared_ptr<CharacterController> > characters;
+	Vertex target;
+	float time;
+
+	Horde(Pathfinding::NavMesh & _navmesh, Timings & _timings, bool _corridor, int count, int threads) :
+		navmesh(_navmesh),
+		timings(_timings),
+		corridor(_corridor),
+		jobs(threads),
+		frametime(0),
+		dispatcher(&configuration, jobs),
+		solver(jobs),
+		world(new ProfiledWorld(&dispatcher, &broadphase, &solver, &configuration, _timings)),
+		scheduler(_navmesh),
+		goalfield(_navmesh),
+		crowd(_navmesh, scheduler),
+		time(0)
+	{
+		world->setGravity(btVector3(0, -20, 0));
+		world->setInternalTickCallback(&Horde::tick, this, true);
+
+		LevelTriangles([&](Vertex const & a, Vertex const & b, Vertex const & c)
+		{
+			levelmesh.addTriangle(btVector3(a.x, a.y, a.z), btVector3(b.x, b.y, b.z), btVector3(c.x, c.y, c.z));
+		});
+		levelshape.reset(new btBvhTriangleMeshShape(&levelmesh, true));
+		levelbody.reset(new btRigidBody(0, 0, levelshape.get()));
+		world->addRigidBody(levelbody.get());
+
+		// On a 1.2 m grid, away from the pillars, in a random order so
+		// that small hordes are spread over the level too
+		std::vector<Vertex> positions;
+		for(float x = -LevelSize / 2 + 1; x < LevelSize / 2 - 1; x += 1.2)
+			for(float z = -LevelSize / 2 + 1; z < LevelSize / 2 - 1; z += 1.2)
+				if (!InPillar(x, z, 0.8))
+					positions.push_back(Vertex(x, 0.5, z));
+
+		srand(0);
+		std::random_shuffle(positions.begin(), positions.end(), [](int n) { return rand() % n; });
+
+		if (count > (int)positions.size())
+			count = positions.size();
+
+		for(int i = 0; i < count; ++i)
+		{
+			btVector3 position(positions[i].x, positions[i].y, positions[i].z);
+			characters.push_back(std::shared_ptr<CharacterController>(new CharacterController(0, world, "Sinbad.mesh", 1.2, 30, position, 0, 100)));
+
+			if (!corridor)
+				characters.back()->JoinCrowd(crowd, 3);
+		}
+
+		const size_t AnimationBatch = 4;
+		for(size_t i = 0; i < characters.size(); i += AnimationBatch)
+		{
+			const size_t first = i, last = std::min(i + AnimationBatch, characters.size());
+			animation.Add([this, first, last]()
+			{
+				for(size_t j = first; j < last; ++j)
+					characters[j]->UpdateGraphics(frametime);
+			});
+		}
+	}
+
+	~Horde()
+	{
+		characters.clear();
+		world->removeRigidBody(levelbody.get());
+	}
+
+	static void tick(btDynamicsWorld * world, btScalar dt)
+	{
+		static_cast<Horde *>(world->getWorldUserInfo())->update(dt);
+	}
+
+	void update(float dt)
+	{
+		// The target runs at 3 m/s on a 20 m circle
+		time += dt;
+		target = Vertex(20 * cos(time * 3 / 20), 0, 20 * sin(time * 3 / 20));
+
+		boost::posix_time::ptime t = Now();
+		contacts.Build(*world->getDispatcher());
+		timings.Add(Contacts, t);
+
+		if (corridor)
+		{
+			t = Now();
+			BOOST_FOREACH(auto & cc, characters)
+				cc->UpdateAITarget(target, scheduler, 3);
+			timings.Add(UpdateAITarget, t);
+
+			t = Now();
+			BOOST_FOREACH(auto & cc, characters)
+				cc->UpdateAI(dt);
+			timings.Add(UpdateAI, t);
+		}
+		else
+		{
+			t = Now();
+			goalfield.Build(target);
+			timings.Add(GoalField, t);
+
+			t = Now();
+			BOOST_FOREACH(auto & cc, characters)
+			{
+				if (goalfield.IsValid())
+					crowd.SetTarget(cc->GetCrowdAgent(), goalfield);
+				else
+					crowd.SetTarget(cc->GetCrowdAgent(), target);
+				cc->UpdateCrowdState(crowd);
+			}
+
+			if (navmesh.Update(boost::posix_time::milliseconds(2)))
+				goalfield.Invalidate();
+
+			crowd.Update(dt);
+
+			BOOST_FOREACH(auto & cc, characters)
+				cc->FollowCrowd(crowd);
+			timings.Add(Crowd, t);
+		}
+
+		t = Now();
+		scheduler.Update();
+		timings.Add(PathRequests, t);
+
+		t = Now();
+		BOOST_FOREACH(auto & cc, characters)
+			cc->UpdatePhysics(dt, contacts);
+		timings.Add(Characters, t);
+	}
+
+	// One tick per frame, then the animation as in Game::Update()
+	void frame(float dt)
+	{
+		boost::posix_time::ptime start = Now();
+
+		world->stepSimulation(dt, 1, dt);
+
+		boost::posix_time::ptime t = Now();
+		BOOST_FOREACH(auto & cc, characters)
+			cc->PublishState(true, 1);
+		frametime = dt;
+		jobs.Run(animation);
+		timings.Add(Animation, t);
+
+		timings.Add(Frame, start);
+		timings.EndTick();
+	}
+};
+
+struct Summary
+{
+	double mean, p50, p90, p99, max;
+
+	Summary(std::vector<double> samples)
+	{
+		std::sort(samples.begin(), samples.end());
+
+		mean = 0;
+		for(size_t i = 0; i < samples.size(); ++i)
+			mean += samples[i] / samples.size();
+
+		p50 = percentile(samples, 0.5);
+		p90 = percentile(samples, 0.9);
+		p99 = percentile(samples, 0.99);
+		max = samples.back();
+	}
+
+	static double percentile(std::vector<double> const & sorted, double p)
+	{
+		return sorted[std::min(sorted.size() - 1, (size_t)(p * sorted.size()))];
+	}
+};
+
+int main(int argc, char * argv[])
+{
+	enum { Text, CSV, JSON } format = Text;
+	bool corridor = false;
+	int ticks = 600;
+	int threads = std::max(1, (int)std::thread::hardware_concurrency());
+	std::vector<int> counts;
+
+	for(int i = 1; i < argc; ++i)
+	{
+		if (!strcmp(argv[i], "--csv"))
+			format = CSV;
+		else if (!strcmp(argv[i], "--json"))
+			format = JSON;
+		else if (!strcmp(argv[i], "--corridor"))
+			corridor = true;
+		else if (!strcmp(argv[i], "--ticks") && i + 1 < argc)
+			ticks = atoi(argv[++i]);
+		else if (!strcmp(argv[i], "--threads") && i + 1 < argc)
+			threads = std::max(1, atoi(argv[++i]));
+		else
+			counts.push_back(atoi(argv[i]));
+	}
+
+	if (counts.empty())
+	{
+		const int defaults[] = { 10, 20, 50, 100, 200, 500, 1000, 2000 };
+		counts.assign(defaults, defaults + sizeof(defaults) / sizeof(defaults[0]));
+	}
+
+	// The mesh is read from the resources of the game, relative to tests/
+	const char * resources = "../resources/models/Sinbad.zip";
+	if (!std::ifstream(resources))
+	{
+		std::cerr << "bench_horde: cannot open " << resources << ", run it from the tests directory\n";
+		return 1;
+	}
+
+	// Ogre without a render system, as in the headless mode of the game:
+	// the meshes are loaded in system memory. The buffer manager must
+	// outlive the meshes, which are destroyed with the root.
+	Ogre::LogManager * logs = new Ogre::LogManager;
+	logs->createLog("bench_horde.log", true, false, true);
+	Ogre::Root * root = new Ogre::Root("", "", "");
+	Ogre::DefaultHardwareBufferManager * buffers = new Ogre::DefaultHardwareBufferManager;
+	Ogre::ResourceGroupManager::getSingleton().addResourceLocation(resources, "Zip");
+
+	Pathfinding::NavMesh navmesh;
+	BuildLevel(navmesh);
+	navmesh.StartWorkers((int)std::thread::hardware_concurrency() - 1);
+
+	const float dt = 1.0 / 60;
+	const char * steering = corridor ? "corridor" : "crowd";
+
+	if (format == CSV)
+		std::cout << "steering,threads,agents,stage,mean_us,p50_us,p90_us,p99_us,max_us\n";
+	else if (format == JSON)
+		std::cout << "[\n";
+
+	for(size_t run = 0; run < counts.size(); ++run)
+	{
+		Timings timings;
+		int agents;
+		{
+			Horde horde(navmesh, timings, corridor, counts[run], threads);
+			agents = horde.characters.size();
+
+			for(int tick = 0; tick < ticks; ++tick)
+				horde.frame(dt);
+		}
+
+		if (format == Text)
+			std::cout << agents << " agents, " << ticks << " ticks, " << steering << " steering, " << threads << " threads (us: mean / p50 / p90 / p99 / max)\n";
+		else if (format == JSON)
+			std::cout << "  {\"steering\": \"" << steering << "\", \"threads\": " << threads << ", \"agents\": " << agents << ", \"ticks\": " << ticks << ", \"stages\": {";
+
+		bool first = true;
+		for(int i = 0; i < Stages; ++i)
+		{
+			if (timings.Samples[i].empty())
+				continue;
+
+			Summary s(timings.Samples[i]);
+
+			if (format == Text)
+			{
+				std::cout << "    " << StageNames[i] << ": " << std::string(16 - strlen(StageNames[i]), ' ')
+					<< s.mean << " / " << s.p50 << " / " << s.p90 << " / " << s.p99 << " / " << s.max << "\n";
+			}
+			else if (format == CSV)
+			{
+				std::cout << steering << "," << threads << "," << agents << "," << StageNames[i] << ","
+					<< s.mean << "," << s.p50 << "," << s.p90 << "," << s.p99 << "," << s.max << "\n";
+			}
+			else
+			{
+				std::cout << (first ? "\n" : ",\n") << "    \"" << StageNames[i] << "\": {"
+					<< "\"mean\": " << s.mean << ", \"p50\": " << s.p50 << ", \"p90\": " << s.p90
+					<< ", \"p99\": " << s.p99 << ", \"max\": " << s.max << "}";
+			}
+
+			first = false;
+		}
+
+		if (format == JSON)
+			std::cout << "}}" << (run + 1 < counts.size() ? ",\n" : "\n");
+	}
+
+	if (format == JSON)
+		std::cout << "]\n";
+
+	delete root;
+	delete buffers;
+	delete logs;
+
+	return 0;
+}
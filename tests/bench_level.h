@@ -0,0 +1,91 @@
+// -*- c++ -*-
+
+// Synthetic level shared by the pathfinding benchmarks
+
+#ifndef BENCH_LEVEL_H
+#define BENCH_LEVEL_H
+
+#include "../src/Pathfinding/Pathfinding.h"
+
+#include <cstdlib>
+#include <cmath>
+
+typedef Pathfinding::Vertex Vertex;
+
+template<class F> static void AddQuad(F & triangle, Vertex const & a, Vertex const & b, Vertex const & c, Vertex const & d)
+{
+	triangle(a, b, c);
+	triangle(a, c, d);
+}
+
+template<class F> static void AddPillar(F & triangle, float x, float z, float size, float height)
+{
+	Vertex p[8] = {
+		Vertex(x, 0, z), Vertex(x + size, 0, z), Vertex(x + size, 0, z + size), Vertex(x, 0, z + size),
+		Vertex(x, height, z), Vertex(x + size, height, z), Vertex(x + size, height, z + size), Vertex(x, height, z + size)
+	};
+
+	AddQuad(triangle, p[4], p[5], p[6], p[7]);
+	AddQuad(triangle, p[0], p[1], p[5], p[4]);
+	AddQuad(triangle, p[1], p[2], p[6], p[5]);
+	AddQuad(triangle, p[2], p[3], p[7], p[6]);
+	AddQuad(triangle, p[3], p[0], p[4], p[7]);
+}
+
+static const float LevelSize = 80;
+
+// Pillars are 3 m wide, every 8 m
+static bool InPillar(float x, float z, float margin)
+{
+	const float px = fmodf(x + LevelSize / 2 - 5, 8);
+	const float pz = fmodf(z + LevelSize / 2 - 5, 8);
+	return px > -margin && px < 3 + margin && pz > -margin && pz < 3 + margin &&
+	       fabsf(x) < LevelSize / 2 - 5 + margin && fabsf(z) < LevelSize / 2 - 5 + margin;
+}
+
+// 80 m x 80 m floor with a grid of pillars, so that paths need a few
+// corners. triangle(a, b, c) is called for each triangle.
+template<class F> static void LevelTriangles(F triangle)
+{
+	const float size = LevelSize;
+
+	for(float x = -size / 2; x < size / 2; x += 2)
+	{
+		for(float z = -size / 2; z < size / 2; z += 2)
+		{
+			AddQuad(triangle, Vertex(x, 0, z), Vertex(x, 0, z + 2), Vertex(x + 2, 0, z + 2), Vertex(x + 2, 0, z));
+		}
+	}
+
+	for(float x = -size / 2 + 5; x < size / 2 - 5; x += 8)
+	{
+		for(float z = -size / 2 + 5; z < size / 2 - 5; z += 8)
+		{
+			AddPillar(triangle, x, z, 3, 3);
+		}
+	}
+}
+
+static void BuildLevel(Pathfinding::NavMesh & navmesh)
+{
+	LevelTriangles([&](Vertex const & a, Vertex const & b, Vertex const & c)
+	{
+		navmesh.AddTriangle(a, b, c, 1);
+	});
+
+	navmesh.AgentHeight = 1.8;
+	navmesh.AgentRadius = 0.8;
+	navmesh.AgentMaxSlope = M_PI / 4;
+	navmesh.AgentMaxClimb = 0.5;
+	navmesh.CellHeight = 0.2;
+	navmesh.CellSize = 0.2;
+	navmesh.QueryExtent = Vertex(10, 10, 10);
+	navmesh.Build();
+}
+
+static float Random(float min, float max)
+{
+	return min + (max - min) * rand() / (float)RAND_MAX;
+}
+
+#endif // BENCH_LEVEL_H
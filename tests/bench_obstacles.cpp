@@ -0,0 +1,109 @@
+/*
+    Dynamic obstacle benchmark: adds and removes obstacles on a tiled
+    navmesh and compares the time spent rebuilding the tiles they touch
+    with the time of a full build. Also checks that paths go around the
+    obstacles, and that a navmesh loaded from the cache can be changed.
+*/
+
+#include "../src/Pathfinding/Pathfinding.h"
+#include "bench_level.h"
+
+#include <boost/date_time.hpp>
+#include <boost/foreach.hpp>
+
+#include <iostream>
+#include <cstdio>
+
+static float Length(Pathfinding::NavMesh::Path const & path)
+{
+	float length = 0;
+	for(size_t i = 1; i < path.size(); ++i)
+		length += path[i].distance(path[i - 1]);
+	return length;
+}
+
+static bool Check(bool condition, const char * message)
+{
+	if (!condition)
+		std::cout << "FAILED: " << message << "\n";
+	return condition;
+}
+
+int main(int argc, char * argv[])
+{
+	const int obstacles = argc > 1 ? atoi(argv[1]) : 64;
+	const boost::posix_time::time_duration budget = boost::posix_time::milliseconds(2);
+	bool ok = true;
+
+	Pathfinding::NavMesh navmesh;
+	navmesh.TileSize = 64;
+	BuildLevel(navmesh);
+
+	Pathfinding::NavMesh::BuildStats const & stats = navmesh.GetBuildStats();
+	std::cout << "Full build:     " << stats.Tiles << " tiles, " << stats.Time.total_microseconds() * 1e-3 << " ms\n";
+
+	navmesh.Save("bench_obstacles.cache", 42);
+
+	// A wall between two pillars, across the straight path
+	const Vertex start(-20, 0, 1.5);
+	const Vertex end(20, 0, 1.5);
+	const float length = Length(navmesh.Query(start, end));
+
+	Pathfinding::NavMesh::ObstacleRef wall = navmesh.AddBoxObstacle(Vertex(-2, 0, -0.5), Vertex(-1, 2, 5.5));
+	size_t dirty = navmesh.DirtyTiles();
+
+	boost::posix_time::ptime t1 = boost::posix_time::microsec_clock::universal_time();
+	int rebuilt = navmesh.Update(boost::posix_time::seconds(10));
+	boost::posix_time::time_duration t = boost::posix_time::microsec_clock::universal_time() - t1;
+
+	Pathfinding::NavMesh::Path path = navmesh.Query(start, end);
+	std::cout << "Add wall:       " << rebuilt << " / " << dirty << " tiles, " << t.total_microseconds() * 1e-3 << " ms, "
+		<< "path " << length << " m -> " << Length(path) << " m\n";
+	ok &= Check(!path.empty() && Length(path) > length + 1, "the path goes around the wall");
+
+	navmesh.RemoveObstacle(wall);
+	navmesh.Update(boost::posix_time::seconds(10));
+	ok &= Check(fabs(Length(navmesh.Query(start, end)) - length) < 0.01, "the path is restored when the wall is removed");
+
+	// Crates dropped at random, rebuilt with a per-frame budget
+	srand(42);
+	std::vector<Pathfinding::NavMesh::ObstacleRef> refs;
+	for(int i = 0; i < obstacles; ++i)
+		refs.push_back(navmesh.AddCylinderObstacle(Vertex(Random(-38, 38), 0, Random(-38, 38)), 0.5, 1));
+
+	dirty = navmesh.DirtyTiles();
+	int frames = 0;
+	boost::posix_time::time_duration worst;
+	t = boost::posix_time::time_duration();
+	while(navmesh.DirtyTiles())
+	{
+		t1 = boost::posix_time::microsec_clock::universal_time();
+		navmesh.Update(budget);
+		boost::posix_time::time_duration frame = boost::posix_time::microsec_clock::universal_time() - t1;
+		worst = std::max(worst, frame);
+		t += frame;
+		++frames;
+	}
+
+	std::cout << "Add " << obstacles << " crates: " << dirty << " tiles in " << frames << " frames, "
+		<< t.total_microseconds() * 1e-3 << " ms, worst frame " << worst.total_microseconds() * 1e-3 << " ms\n";
+
+	BOOST_FOREACH(auto ref, refs)
+		navmesh.RemoveObstacle(ref);
+	navmesh.Update(boost::posix_time::seconds(10));
+
+	// Tiles loaded from the cache keep their compact heightfield
+	Pathfinding::NavMesh loaded;
+	loaded.TileSize = 64;
+	BuildLevel(loaded);
+	ok &= Check(loaded.Load("bench_obstacles.cache", 42), "the cache is loaded");
+	loaded.AddBoxObstacle(Vertex(-2, 0, -0.5), Vertex(-1, 2, 5.5));
+	loaded.Update(boost::posix_time::seconds(10));
+	navmesh.AddBoxObstacle(Vertex(-2, 0, -0.5), Vertex(-1, 2, 5.5));
+	navmesh.Update(boost::posix_time::seconds(10));
+	ok &= Check(fabs(Length(loaded.Query(start, end)) - Length(navmesh.Query(start, end))) < 0.01, "the loaded navmesh is rebuilt like the built one");
+
+	std::remove("bench_obstacles.cache");
+
+	return ok ? 0 : 1;
+}
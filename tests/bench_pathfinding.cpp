@@ -0,0 +1,59 @@
+/*
+    Pathfinding query benchmark: compares a fresh query context per path
+    request with the per-thread pooled context used by NavMesh::Query.
+*/
+
+#include "../src/Pathfinding/Pathfinding.h"
+#include "bench_level.h"
+
+#include <boost/date_time.hpp>
+
+#include <iostream>
+
+int main(int argc, char * argv[])
+{
+	const int agents = argc > 1 ? atoi(argv[1]) : 128;
+	const int ticks = argc > 2 ? atoi(argv[2]) : 50;
+
+	Pathfinding::NavMesh navmesh;
+	BuildLevel(navmesh);
+
+	std::vector<Vertex> positions;
+	srand(42);
+	for(int i = 0; i < agents; ++i)
+		positions.push_back(Vertex(Random(-38, 38), 0, Random(-38, 38)));
+
+	for(int mode = 0; mode < 2; ++mode)
+	{
+		size_t vertices = 0;
+		boost::posix_time::ptime t1 = boost::posix_time::microsec_clock::universal_time();
+
+		for(int tick = 0; tick < ticks; ++tick)
+		{
+			Vertex target(30 * cos(tick * 0.1), 0, 30 * sin(tick * 0.1));
+
+			for(int i = 0; i < agents; ++i)
+			{
+				if (mode == 0)
+				{
+					std::unique_ptr<Pathfinding::NavMesh::QueryContext> context = navmesh.CreateQueryContext();
+					vertices += navmesh.Query(positions[i], target, *context).size();
+				}
+				else
+				{
+					vertices += navmesh.Query(positions[i], target).size();
+				}
+			}
+		}
+
+		boost::posix_time::time_duration t = boost::posix_time::microsec_clock::universal_time() - t1;
+		double queries = (double)agents * ticks;
+
+		std::cout << (mode == 0 ? "Context per query: " : "Pooled context:    ")
+			<< agents << " agents, " << ticks << " ticks, "
+			<< queries / (t.total_microseconds() * 1e-6) << " queries/s, "
+			<< vertices / queries << " vertices/path\n";
+	}
+
+	return 0;
+}
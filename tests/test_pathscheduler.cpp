@@ -0,0 +1,99 @@
+/*
+    Partial paths test: an agent walks along the partial paths of a sliced
+    request while the scheduler works on it over many ticks, taking each
+    new revision as CharacterController::UpdateAITarget() does.
+
+    Each revision starts where the path was requested, so the agent must
+    skip the corners it has already reached instead of walking back to
+    them. The test fails if it heads for a reached corner, if the path is
+    not replaced several times, or if the agent does not reach the target.
+*/
+
+#include "../src/Pathfinding/PathScheduler.h"
+#include "bench_level.h"
+
+#include <algorithm>
+#include <iostream>
+#include <vector>
+
+int main(int argc, char * argv[])
+{
+	const float dt = 1.0 / 60;
+	const float speed = 4;
+	const float cornerdistance = 0.2;
+	const Vertex start(-36, 0, -36);
+	const Vertex end(36, 0, 36);
+
+	Pathfinding::NavMesh navmesh;
+	BuildLevel(navmesh);
+
+	// A few A* iterations per tick, so that the request takes many ticks
+	Pathfinding::PathScheduler scheduler(navmesh);
+	scheduler.IterationBudget = 4;
+	Pathfinding::PathScheduler::RequestPtr request = scheduler.Submit(start, end);
+
+	Pathfinding::NavMesh::Path path;
+	int revision = 0;
+	int revisions = 0;
+	size_t corner = 1;
+	std::vector<Vertex> reached;
+	Vertex position = start;
+
+	for(int tick = 0; tick < 60 * 60; ++tick)
+	{
+		scheduler.Update();
+
+		if (request->GetStatus() == Pathfinding::PathScheduler::Failed)
+		{
+			std::cerr << "test_pathscheduler: the request failed\n";
+			return 1;
+		}
+
+		if (request->GetStatus() != Pathfinding::PathScheduler::Queued && request->GetRevision() != revision)
+		{
+			revision = request->GetRevision();
+			path = request->GetPath();
+			corner = path.NextCorner(position, 1, cornerdistance);
+			++revisions;
+
+			if (corner < path.size())
+			{
+				for(size_t i = 0; i < reached.size(); ++i)
+				{
+					if (reached[i].squaredDistance(Vertex(path[corner].x, 0, path[corner].z)) < cornerdistance * cornerdistance)
+					{
+						std::cerr << "test_pathscheduler: revision " << revision << " goes back to corner " << i << " at tick " << tick << "\n";
+						return 1;
+					}
+				}
+			}
+		}
+
+		if (path.size() < 2)
+			continue;
+
+		Vertex direction = Vertex(path[corner].x, 0, path[corner].z) - Vertex(position.x, 0, position.z);
+		const float distance = direction.normalise();
+		position += direction * std::min(distance, speed * dt);
+
+		const size_t next = path.NextCorner(position, corner, cornerdistance);
+		for(; corner < next; ++corner)
+			reached.push_back(Vertex(path[corner].x, 0, path[corner].z));
+
+		if (request->Done() && Vertex(position.x, 0, position.z).squaredDistance(Vertex(end.x, 0, end.z)) < cornerdistance * cornerdistance)
+		{
+			std::cout << "Target reached after " << tick << " ticks, " << revisions << " paths, " << reached.size() << " corners\n";
+
+			if (revisions < 3)
+			{
+				std::cerr << "test_pathscheduler: the path was only replaced " << revisions << " times\n";
+				return 1;
+			}
+
+			return 0;
+		}
+	}
+
+	std::cerr << "test_pathscheduler: the target was not reached\n";
+	return 1;
+}
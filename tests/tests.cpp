@@ -82,7 +82,12 @@ int main(int argc, char * argv[])
 	body->setContactProcessingThreshold(0);
 	cube->setContactProcessingThreshold(0);
 
-	std::fstream f("out.txt", std::fstream::out);
+	// The trajectory of the cube goes to the file given on the command
+	// line, or to the standard output
+	std::fstream file;
+	if (argc > 1)
+		file.open(argv[1], std::fstream::out);
+	std::ostream & f = argc > 1 ? file : std::cout;
 
 	const float dt = 1.0 / 60.0;
 	for(float t = 0; t < 10; t += dt)